@@ -1,3 +1,4 @@
+#define _GNU_SOURCE 1
 #include <ctype.h>
 #include <dirent.h>
 #include <stdio.h>
@@ -5,12 +6,41 @@
 #include <pwd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <fcntl.h>
 #include "config.h"
+#include "util.h"
+#include "pattern.h"
+#include "desktop.h"
+#include "pathcache.h"
+#include "modifiers.h"
+#include "pathprobe.h"
+#include "wlclip.h"
+#include "memfile.h"
+#include "dirscan.h"
+#include "archive.h"
+#include "localconfig.h"
+#include "warmpool.h"
+#include "probes.h"
+#include "compiled_config.h"
+#ifdef HAVE_DEFAULT_CONFIG
+// DEFAULT_CONFIG: the rules embedded in the executable by aperi_compile
+#include "default_config.h"
+#endif
+
+PROBE_SEMAPHORE(aperi, config_open);
+PROBE_SEMAPHORE(aperi, rule_match);
+PROBE_SEMAPHORE(aperi, wrapper_hit);
+PROBE_SEMAPHORE(aperi, exec);
 
 const char* GLOBAL_CONFIG_DIR = "/etc/aperi/";
+// Scheme of the URIs passed by aperi_fm1 for the ShowItems requests, followed by the
+// percent encoded path of the item
+const char* SHOW_ITEMS_SCHEME = "aperi-show-items://";
 
 // Argument types (file, directory or uri)
 typedef enum ArgType { ATFile, ATDir, ATURI } ArgType;
@@ -22,16 +52,57 @@ typedef struct Aperi {
     char* file_path;
     // Type of the argument (file, directory, uri)
     ArgType arg_type;
+    // Result of the stat of the argument (zeroed for URIs and unverified arguments)
+    struct stat arg_stat;
+    // Absolute path of the argument (the argument itself for URIs)
+    char* real_path;
+    // Absolute path of the local file referred by the argument: the real path for files
+    // and the decoded path for aperi-show-items:// URIs (NULL for other URIs)
+    char* local_path;
+    // the argument couldn't be probed in time: its path was resolved lexically, and its
+    // type is unknown (it's handled as a file)
+    int unverified;
     // Path to the config directory
     char* config_dir_path;
     // Aperi config file
     FILE* config_f;
+    // memory mapping of the compiled config read by config_f (NULL if not used)
+    void* config_map;
+    size_t config_map_size;
     // the last parsed char from the config file is inside double quotes
     int quoting;
+    // glob/regex rules met while searching the matching rule
+    PatternSet* patterns;
+    // offset in the config file of the command of each glob/regex rule, by rule id
+    long* pattern_offsets;
+    int n_patterns;
+    // glob/regex rules of the current line, added to `patterns` once its `=` is reached
+    char** line_patterns;
+    int n_line_patterns;
+    // index of the rule line being checked, counting from 0, and of the line of each
+    // glob/regex rule (reported by the rule_match probe)
+    int rule_index;
+    int* pattern_rules;
+    // modifiers of the rule being launched
+    Modifiers modifiers;
+    // content of the directory argument, read by the first directory rule (see dirscan.h)
+    DirScan dir_scan;
+    int dir_scanned;
+    // name (`stdin.<extension>`) of the content read from the standard input for
+    // `aperi -`, NULL otherwise
+    char* stdin_name;
+    // cached copy of the archive member for `<archive>#<member>` arguments (see
+    // archive.h), NULL otherwise
+    char* member_path;
+    // print the command instead of running it (`aperi --query`)
+    int query;
+    // id of the desktop entry being launched, NULL for the other commands
+    const char* desktop_id;
 } Aperi;
 
-// Init aperi struct members. `file_path` is the url/file to open.
-void aperi_init(Aperi* aperi, char* file_path);
+/* Init aperi struct members. `file_path` is the url/file to open, or `-` to open the
+ * standard input as a file of type `type` (an extension, or NULL to detect it) */
+void aperi_init(Aperi* aperi, char* file_path, const char* type);
 
 // Deallocate all resources allocated for the aperi struct
 void aperi_deinit(Aperi* aperi);
@@ -50,9 +121,49 @@ void aperi_read_line_to(Aperi* aperi, char sep);
  * end of line/file, whatever comes first */
 int aperi_line_match(Aperi* aperi);
 
-/* open the configuration file and set aperi->config_f */
+/* Evaluate the rule predicate `predicate` (like `size>1G` or `!exec`) on the stat of the
+ * argument. Return 1 if it holds, 0 if it doesn't (always for URIs and unverified
+ * arguments) and -1 if it's invalid */
+int aperi_check_predicate(Aperi* aperi, const char* predicate);
+
+/* Return 1 if all the NUL separated predicates from `predicates` to `end` hold, else 0.
+ * Invalid predicates are reported and don't hold. */
+int aperi_predicates_hold(Aperi* aperi, const char* predicates, const char* end);
+
+/* Return 1 if the directory rule `rule` (`/<name>`, matching directories containing
+ * `name`, or `/` followed by `*.<extension>`, matching directories mostly containing
+ * files with that extension) matches the directory argument */
+int aperi_dir_rule_match(Aperi* aperi, const char* rule);
+
+/* Return 1 if `rule` is a glob (`glob:<pattern>`) or regex (`regex:<pattern>`) rule */
+int is_pattern_rule(const char* rule);
+
+/* Add the glob/regex rules of the current line to aperi->patterns. The config file must be
+ * positioned at the beginning of the line command. */
+void aperi_commit_line_patterns(Aperi* aperi);
+
+/* Free aperi->patterns and the related data */
+void aperi_reset_patterns(Aperi* aperi);
+
+/* Search the first rule matching the current resource, starting from the current position
+ * of the config file. Return 1 and leave the file positioned at the beginning of the rule
+ * command if a rule is found, else return 0. The glob/regex rules met during the search are
+ * evaluated together once the first matching plain rule (or the end of file) is reached. */
+int aperi_find_rule(Aperi* aperi);
+
+/* open the configuration file and set aperi->config_f. The config is read from its
+ * compiled form when available. If there's no config file the rules compiled in the
+ * executable (if any) are used */
 void aperi_open_config_file(Aperi* aperi);
 
+/* open the nearest `.aperi` override config of the argument directory (see
+ * localconfig.h) and set aperi->config_f, or leave it NULL if there's none */
+void aperi_open_local_config(Aperi* aperi);
+
+/* open the compiled config `<cfgpath>.compiled` and set aperi->config_f, unless it doesn't
+ * exist, it's invalid or it's older than `cfgpath` */
+void aperi_open_compiled_config(Aperi* aperi, const char* cfgpath);
+
 /* close the configuration file and reset aperi->config_f */
 void aperi_close_config_file(Aperi* aperi);
 
@@ -69,46 +180,91 @@ void aperi_launch_associated_app(Aperi* aperi);
  * to the list of arguments */
 void aperi_read_app_and_launch(Aperi *aperi);
 
+/* this function is called when the command of a matching rule starts with `[`. Read the
+ * rule modifiers up to the closing `]` and set them in aperi->modifiers. Invalid modifiers
+ * are reported and ignored. */
+void aperi_read_modifiers(Aperi *aperi);
+
+/* this function is called when the command of a matching rule is a desktop entry id
+ * (`@<id>`). Read the id up to the end of the line and exec the Exec command of the desktop
+ * entry, with its field codes expanded for the aperi argument */
+void aperi_launch_desktop_entry(Aperi *aperi);
+
+/* exec the command `argv` with the rule modifiers applied, resolving the executable through
+ * the PATH cache. Return only if the command couldn't be executed: when the executable
+ * doesn't exist the rule is reported as skipped. If the exec fails after modifiers
+ * changing the process or its directory were applied, exit instead of trying the next
+ * rules. A rule without command (`argv[0]` NULL) runs only the built-in actions of its
+ * modifiers */
+void aperi_exec(Aperi* aperi, char** argv);
+
+/* read the standard input in a sealed memory file and use it as the argument, matched by
+ * the name `stdin.<type>` (with `type` recognized from the content if NULL) and passed
+ * to the command as `/proc/<pid>/fd/<fd>`. Return 1 on errors. */
+int aperi_read_stdin(Aperi* aperi, const char* type);
+
 /* check if the current argument is a directory, a URI or a file setting the
- * relative member in the aperi structure. Return 1 if the file is a non
- * existant file or directory. */
+ * relative member in the aperi structure, and resolve its real path. Return 1 if the
+ * file is a non existant file or directory. If the argument can't be probed in time it's
+ * marked as unverified. */
 int aperi_analyze_arg(Aperi* aperi);
 
-/* Replace argp with a string where all placeholders (like %f) are substituted with their
- * expanded value */
-void aperi_normalize_arg(Aperi* aperi, char** argp);
-
-// Utility functions
-/* Like malloc, but print a message and exit in case of errors */
-void *xmalloc(size_t size);
-
-/* Like realloc, but print a message and exit in case of errors */
-void *xrealloc(void* p, size_t size);
+/* If the argument is `<archive>#<member>`, where `<archive>` is an existing supported
+ * archive, extract the member (see archive.h) and analyze it in place of the argument.
+ * Return 0 on success */
+int aperi_open_archive_member(Aperi* aperi);
 
-/* Like realpath, but print a message and exit in case of errors */
-char *xrealpath(const char *path, char *resolved_path);
+/* run the built-in actions of the rule modifiers (copy to the clipboard, start of the
+ * server of a client command, change of the working directory) before the command `argv`
+ * is executed. If the rule has no command (`argv[0]` is NULL), exit after the actions.
+ * Return 1 if the server of a client command isn't live: the command can't run */
+int aperi_run_actions(Aperi* aperi, char** argv);
 
-/* Percent decode `s` (see https://en.wikipedia.org/wiki/Percent-encoding) */
-void percent_decode(char* s);
+/* print the command `argv` (`@<id>` for desktop entries) for `aperi --query`, quoted for
+ * the shell, and exit */
+void aperi_print_command(Aperi* aperi, char** argv);
 
-/* return 1 if path is a directory, else 0 */
-int isdir(const char* path);
+/* Return the decoded absolute path of the aperi-show-items:// URI `uri` (to be freed), or
+ * NULL if `uri` has a different scheme */
+char* aperi_show_items_path(const char* uri);
 
-/* skip to the next non empty line in file `f` */
-int next_line(FILE* f);
+/* Return the expanded value of the placeholder `%<c>` (to be freed), or NULL if `c` is not
+ * a valid placeholder */
+char* aperi_placeholder(Aperi* aperi, char c);
 
-/* return a pointer to a string containing the current user home directory.
- * The string must not be modified or freed */
-const char* get_homedir();
+/* Replace argp with a string where all placeholders (like %f) are substituted with their
+ * expanded value. `*argp` must be allocated with malloc(): it is freed */
+void aperi_normalize_arg(Aperi* aperi, char** argp);
 
-/* Like strncmp, but compare strings case insensitive (using tolower()) */
-int strnicmp(const char* s1, const char* s2, size_t n);
+/* `aperi --warm <n>`: start the servers of the `n` most hit server rules of the config
+ * (see warm_start()) */
+int aperi_warm(int n);
 
 // Implementation
 
-void aperi_init(Aperi* aperi, char* file_path) {
+void aperi_init(Aperi* aperi, char* file_path, const char* type) {
     aperi->config_f = NULL;
+    aperi->config_map = NULL;
+    aperi->patterns = NULL;
+    aperi->pattern_offsets = NULL;
+    aperi->n_patterns = 0;
+    aperi->line_patterns = NULL;
+    aperi->n_line_patterns = 0;
+    aperi->pattern_rules = NULL;
+    modifiers_init(&aperi->modifiers);
+    aperi->stdin_name = NULL;
+    aperi->member_path = NULL;
+    aperi->query = 0;
+    aperi->desktop_id = NULL;
+    aperi->dir_scanned = 0;
     aperi_init_config_dir_path(aperi);
+    if (strcmp(file_path, "-") == 0) {
+        if (aperi_read_stdin(aperi, type) != 0) {
+            aperi_deinit(aperi);
+            exit(1);
+        }
+        return;
+    }
     // If file_path starts with file://, remove it
     if (strncmp(file_path, "file://", 7) == 0) {
         aperi->file_path = file_path + 7;
@@ -117,7 +273,7 @@ void aperi_init(Aperi* aperi, char* file_path) {
         aperi->file_path = file_path;
     }
 
-    if (aperi_analyze_arg(aperi) != 0)  {
+    if (aperi_analyze_arg(aperi) != 0 && aperi_open_archive_member(aperi) != 0)  {
         fprintf(stderr, "Couldn't stat %s. Exiting.\n", aperi->file_path);
         aperi_deinit(aperi);
         exit(1);
@@ -126,7 +282,14 @@ void aperi_init(Aperi* aperi, char* file_path) {
 
 void aperi_deinit(Aperi* aperi) {
     aperi_close_config_file(aperi);
+    aperi_reset_patterns(aperi);
+    free(aperi->real_path);
+    free(aperi->local_path);
+    free(aperi->stdin_name);
+    free(aperi->member_path);
+    if (aperi->dir_scanned) dir_scan_free(&aperi->dir_scan);
     free(aperi->config_dir_path);
+    modifiers_free(&aperi->modifiers);
 }
 
 void aperi_init_config_dir_path(Aperi* aperi) {
@@ -175,22 +338,84 @@ void aperi_read_line_to(Aperi* aperi, char sep) {
     }
 }
 
+int aperi_read_stdin(Aperi* aperi, const char* type) {
+    aperi->arg_type = ATFile;
+    aperi->unverified = 0;
+    aperi->real_path = NULL;
+    aperi->local_path = NULL;
+    int fd = memfile_from_fd(STDIN_FILENO, "stdin");
+    if (fd < 0) return 1;
+    if (!type) {
+        unsigned char head[512];
+        ssize_t ln = pread(fd, head, sizeof(head), 0);
+        type = sniff_extension(head, ln > 0 ? ln : 0);
+    }
+    fstat(fd, &aperi->arg_stat);
+    int ln = snprintf(NULL, 0, "stdin.%s", type);
+    aperi->stdin_name = xmalloc(ln + 1);
+    snprintf(aperi->stdin_name, ln + 1, "stdin.%s", type);
+    aperi->file_path = aperi->stdin_name;
+    // the command replaces aperi in the same process, so the path stays valid as long as
+    // the command runs, also for the processes it starts (unlike /proc/self)
+    ln = snprintf(NULL, 0, "/proc/%d/fd/%d", (int)getpid(), fd);
+    aperi->real_path = xmalloc(ln + 1);
+    snprintf(aperi->real_path, ln + 1, "/proc/%d/fd/%d", (int)getpid(), fd);
+    aperi->local_path = strdup(aperi->real_path);
+    return 0;
+}
+
 int aperi_analyze_arg(Aperi* aperi) {
     aperi->arg_type = ATFile;
+    aperi->unverified = 0;
+    aperi->real_path = NULL;
+    aperi->local_path = NULL;
+    memset(&aperi->arg_stat, 0, sizeof(struct stat));
 
     // Check if path exists. If it does, set the dir type when needed, and return '/'
-    struct stat statbuf;
-    if (stat(aperi->file_path, &statbuf) == 0) {
-        if ((statbuf.st_mode & S_IFMT) == S_IFDIR) {
+    struct stat* statbuf = &aperi->arg_stat;
+    ProbeResult probe = path_probe(aperi->file_path, statbuf, &aperi->real_path);
+    if (probe == ProbeOk) {
+        if ((statbuf->st_mode & S_IFMT) == S_IFDIR) {
             aperi->arg_type = ATDir;
         }
+        if (!aperi->real_path) aperi->real_path = lexical_path(aperi->file_path);
+        aperi->local_path = strdup(aperi->real_path);
         return 0;
     }
 
     if (strstr(aperi->file_path, "://")) {
         aperi->arg_type = ATURI;
+        aperi->real_path = strdup(aperi->file_path);
+        aperi->local_path = aperi_show_items_path(aperi->file_path);
+        return 0;
     }
-    return aperi->arg_type != ATURI;
+    if (probe == ProbeTimeout) {
+        fprintf(stderr, "Timeout probing %s: matching it by name only\n", aperi->file_path);
+        aperi->unverified = 1;
+        aperi->real_path = lexical_path(aperi->file_path);
+        aperi->local_path = strdup(aperi->real_path);
+        return 0;
+    }
+    return 1;
+}
+
+int aperi_open_archive_member(Aperi* aperi) {
+    const char* arg = aperi->file_path;
+    // the archive path may contain '#' too: try every split
+    for (const char* sep = strchr(arg, '#'); sep; sep = strchr(sep + 1, '#')) {
+        if (!sep[1]) break;
+        char* archive = strndup(arg, sep - arg);
+        struct stat st;
+        if (archive_supported(archive) && stat(archive, &st) == 0 && S_ISREG(st.st_mode)) {
+            aperi->member_path = archive_extract(archive, sep + 1);
+            free(archive);
+            if (!aperi->member_path) return 1;
+            aperi->file_path = aperi->member_path;
+            return aperi_analyze_arg(aperi);
+        }
+        free(archive);
+    }
+    return 1;
 }
 
 int aperi_line_match(Aperi* aperi) {
@@ -200,6 +425,9 @@ int aperi_line_match(Aperi* aperi) {
     ssize_t pattern_allocation = 64;
     char *current_pattern = (char*)xmalloc(pattern_allocation);
     size_t file_path_ln = strlen(aperi->file_path);
+    aperi->n_line_patterns = 0;
+    // index in current_pattern of the predicates (`&<predicate>`) of the rule, or -1
+    int predicates = -1;
     while(1) {
         int ch = aperi_getc(aperi);
         while (pattern_idx + 2 > pattern_allocation) {
@@ -208,20 +436,36 @@ int aperi_line_match(Aperi* aperi) {
         }
         if (!aperi->quoting && (ch == ',' || ch == '=')) {
             current_pattern[pattern_idx] = 0;
+            // the predicates of the rule, separated by NULs, end here
+            const char* predicates_end = current_pattern + pattern_idx;
+            if (predicates >= 0) pattern_idx = predicates;
             star = strcmp(current_pattern, "/*") == 0;
 
             int match = 0;
-            if (star) {
+            if (predicates >= 0 && pattern_idx == 0) {
+                // only predicates: the rule applies to any argument
+                match = 1;
+            } else if (is_pattern_rule(current_pattern)) {
+                // evaluated later, together with the other glob/regex rules, if its
+                // predicates hold
+                if (predicates < 0 ||
+                    aperi_predicates_hold(aperi, current_pattern + predicates + 1,
+                                          predicates_end)) {
+                    aperi->line_patterns = xrealloc(aperi->line_patterns,
+                            (aperi->n_line_patterns + 1) * sizeof(char*));
+                    aperi->line_patterns[aperi->n_line_patterns++] = strdup(current_pattern);
+                }
+            } else if (star) {
                 match = 1;
             } else if (aperi->arg_type == ATDir) {
-                match = strcmp(current_pattern, "/") == 0;
+                match = strcmp(current_pattern, "/") == 0 ||
+                        aperi_dir_rule_match(aperi, current_pattern);
             } else if (aperi->arg_type == ATURI &&
                        pattern_idx > 3 &&
                        strstr(current_pattern, "://")) {
                 match = strncmp(aperi->file_path, current_pattern, pattern_idx) == 0;
             } else if (aperi->arg_type == ATFile) {
                 // file finisce con .<pattern>
-                current_pattern[pattern_idx+1] = 0;
                 if(file_path_ln - pattern_idx - 1 >= 0 &&
                    aperi->file_path[file_path_ln - pattern_idx - 1] == '.' &&
                    strnicmp(current_pattern,
@@ -231,32 +475,189 @@ int aperi_line_match(Aperi* aperi) {
                     match = 1;
                 }
             }
+            // a matching rule applies only if all its predicates hold too
+            if (match == 1 && predicates >= 0) {
+                match = aperi_predicates_hold(aperi, current_pattern + predicates + 1,
+                                              predicates_end);
+            }
             if (match == 1) {
                 if (ch == ',') aperi_read_line_to(aperi, '=');
                 free(current_pattern);
+                // the whole line is used: its glob/regex rules don't matter anymore
+                for (int i = 0; i < aperi->n_line_patterns; ++i) free(aperi->line_patterns[i]);
+                aperi->n_line_patterns = 0;
                 return 1;
             }
 
             // no more rules on this line -> no match
             if (!aperi->quoting && ch == '=') {
                 free(current_pattern);
+                aperi_commit_line_patterns(aperi);
                 return 0;
             }
             pattern_idx = 0;
             current_pattern[0] = 0;
+            predicates = -1;
         } else if (ch == '\n' || ch == '\r' || ch == EOF) {
             /* end of line/file -> exit from loop */
             break;
+        } else if (ch == '&' && !aperi->quoting) {
+            // predicate separator: the pattern ends at the first one
+            if (predicates < 0) predicates = pattern_idx;
+            current_pattern[pattern_idx] = 0;
+            ++pattern_idx;
         } else {
             current_pattern[pattern_idx] = ch;
             ++pattern_idx;
         }
     }
     free(current_pattern);
-    // no match
+    // no match (and no command for the glob/regex rules of the line)
+    for (int i = 0; i < aperi->n_line_patterns; ++i) free(aperi->line_patterns[i]);
+    aperi->n_line_patterns = 0;
     return 0;
 }
 
+int aperi_check_predicate(Aperi* aperi, const char* predicate) {
+    // file type predicates
+    static const struct { const char* name; mode_t type; } FILE_TYPES[] = {
+        {"file", S_IFREG}, {"dir", S_IFDIR}, {"fifo", S_IFIFO}, {"socket", S_IFSOCK},
+        {"block", S_IFBLK}, {"char", S_IFCHR},
+    };
+    const struct stat* st = &aperi->arg_stat;
+    int negate = predicate[0] == '!';
+    if (negate) ++predicate;
+    int res = -1;
+    if (strncmp(predicate, "size>", 5) == 0 || strncmp(predicate, "size<", 5) == 0) {
+        unsigned long long size;
+        if (parse_size(predicate + 5, &size) != 0) return -1;
+        unsigned long long arg_size = st->st_size;
+        res = predicate[4] == '>' ? arg_size > size : arg_size < size;
+    } else if (strcmp(predicate, "exec") == 0) {
+        res = S_ISREG(st->st_mode) && (st->st_mode & (S_IXUSR | S_IXGRP | S_IXOTH));
+    } else {
+        for (size_t i = 0; i < sizeof(FILE_TYPES) / sizeof(FILE_TYPES[0]); ++i) {
+            if (strcmp(predicate, FILE_TYPES[i].name) == 0) {
+                res = (st->st_mode & S_IFMT) == FILE_TYPES[i].type;
+            }
+        }
+    }
+    if (res < 0) return -1;
+    // nothing is known about URIs and arguments that couldn't be probed
+    if (aperi->arg_type == ATURI || aperi->unverified) return 0;
+    return negate ? !res : res;
+}
+
+int aperi_predicates_hold(Aperi* aperi, const char* predicates, const char* end) {
+    int res = 1;
+    for (const char* p = predicates; p <= end; p += strlen(p) + 1) {
+        int holds = aperi_check_predicate(aperi, p);
+        if (holds < 0) fprintf(stderr, "Invalid rule predicate %s\n", p);
+        if (holds != 1) res = 0;
+    }
+    return res;
+}
+
+int aperi_dir_rule_match(Aperi* aperi, const char* rule) {
+    if (rule[0] != '/' || !rule[1]) return 0;
+    if (!aperi->dir_scanned) {
+        // the directory is read once, by the first directory rule met
+        dir_scan(aperi->real_path, &aperi->dir_scan);
+        aperi->dir_scanned = 1;
+    }
+    if (strncmp(rule, "/*.", 3) == 0) {
+        const char* dominant = aperi->dir_scan.dominant_extension;
+        return dominant && strcasecmp(dominant, rule + 3) == 0;
+    }
+    return dir_scan_has(&aperi->dir_scan, rule + 1);
+}
+
+int is_pattern_rule(const char* rule) {
+    return strncmp(rule, "glob:", 5) == 0 || strncmp(rule, "regex:", 6) == 0;
+}
+
+void aperi_commit_line_patterns(Aperi* aperi) {
+    long offset = ftell(aperi->config_f);
+    for (int i = 0; i < aperi->n_line_patterns; ++i) {
+        char* rule = aperi->line_patterns[i];
+        if (!aperi->patterns) aperi->patterns = pattern_set_new();
+        int res;
+        if (rule[0] == 'g') {
+            res = pattern_set_add_glob(aperi->patterns, rule + 5, aperi->n_patterns);
+        } else {
+            res = pattern_set_add_regex(aperi->patterns, rule + 6, aperi->n_patterns);
+        }
+        if (res == 0) {
+            aperi->pattern_offsets = xrealloc(aperi->pattern_offsets,
+                                              (aperi->n_patterns + 1) * sizeof(long));
+            aperi->pattern_rules = xrealloc(aperi->pattern_rules,
+                                            (aperi->n_patterns + 1) * sizeof(int));
+            aperi->pattern_rules[aperi->n_patterns] = aperi->rule_index;
+            aperi->pattern_offsets[aperi->n_patterns++] = offset;
+        } else {
+            fprintf(stderr, "Invalid rule %s\n", rule);
+        }
+        free(rule);
+    }
+    aperi->n_line_patterns = 0;
+}
+
+void aperi_reset_patterns(Aperi* aperi) {
+    pattern_set_free(aperi->patterns);
+    aperi->patterns = NULL;
+    free(aperi->pattern_offsets);
+    aperi->pattern_offsets = NULL;
+    free(aperi->pattern_rules);
+    aperi->pattern_rules = NULL;
+    aperi->n_patterns = 0;
+    for (int i = 0; i < aperi->n_line_patterns; ++i) free(aperi->line_patterns[i]);
+    free(aperi->line_patterns);
+    aperi->line_patterns = NULL;
+    aperi->n_line_patterns = 0;
+}
+
+int aperi_find_rule(Aperi* aperi) {
+    FILE* f = aperi->config_f;
+    int found = 0;
+    while(!found) {
+        int ch = getc(f);
+        ungetc(ch, f);
+        if (ch == EOF) break;
+        switch(ch) {
+            case '#':
+            case '\n':
+            case '\r':
+                // comment/empty line: skip to next valid line
+                next_line(f);
+                break;
+            default:
+                // check if the current line matches the rule
+                ++aperi->rule_index;
+                found = aperi_line_match(aperi);
+                // no match: skip to next line
+                if (!found) aperi_read_line_to(aperi, '\n');
+        }
+    }
+
+    // glob/regex rules met so far come before the plain rule found (if any)
+    if (aperi->n_patterns > 0) {
+        // the content of the standard input is matched by its name
+        const char* subject = aperi->stdin_name ? aperi->stdin_name : aperi->real_path;
+        int rule = pattern_set_match(aperi->patterns, subject);
+        if (rule >= 0) {
+            fseek(f, aperi->pattern_offsets[rule], SEEK_SET);
+            aperi->rule_index = aperi->pattern_rules[rule];
+            aperi->quoting = 0;
+            found = 1;
+        }
+        aperi_reset_patterns(aperi);
+    }
+    if (found && PROBE_ENABLED(aperi, rule_match)) {
+        PROBE2(aperi, rule_match, aperi->rule_index, ftell(f));
+    }
+    return found;
+}
+
 void aperi_open_config_file(Aperi* aperi) {
     // Open the configuration file from $XDG_CONFIG_HOME/aperi/config
     const char* CONFIG_BASENAME = "config";
@@ -264,14 +665,79 @@ void aperi_open_config_file(Aperi* aperi) {
     char* ptr = cfgpath;
     ptr = stpcpy(cfgpath, aperi->config_dir_path);
     stpcpy(ptr, CONFIG_BASENAME);
-    aperi->config_f = fopen(cfgpath, "rb");
+    aperi->config_f = NULL;
+    aperi_open_compiled_config(aperi, cfgpath);
+    if (!aperi->config_f) aperi->config_f = fopen(cfgpath, "rb");
+    PROBE2(aperi, config_open, cfgpath, aperi->config_f != NULL);
+#ifdef HAVE_DEFAULT_CONFIG
+    if (!aperi->config_f) {
+        // lowest priority rules: the ones embedded in the executable
+        aperi->config_f = fmemopen((void*)DEFAULT_CONFIG, sizeof(DEFAULT_CONFIG) - 1, "r");
+        PROBE2(aperi, config_open, "<default>", aperi->config_f != NULL);
+    }
+#endif
     aperi->quoting = 0;
+    aperi->rule_index = -1;
     free(cfgpath);
 }
 
+void aperi_open_local_config(Aperi* aperi) {
+    aperi->config_f = NULL;
+    // only local files, whose probe completed
+    if (aperi->arg_type == ATURI || aperi->unverified || aperi->stdin_name) return;
+    char* dir = strdup(aperi->local_path);
+    if (aperi->arg_type != ATDir) {
+        char* slash = strrchr(dir, '/');
+        if (slash) *(slash == dir ? slash + 1 : slash) = 0;
+    }
+    int fd = local_config_open(dir, aperi->config_dir_path);
+    free(dir);
+    if (fd >= 0) {
+        aperi->config_f = fdopen(fd, "rb");
+        if (!aperi->config_f) close(fd);
+    }
+    PROBE2(aperi, config_open, ".aperi", aperi->config_f != NULL);
+    aperi->quoting = 0;
+    aperi->rule_index = -1;
+}
+
+void aperi_open_compiled_config(Aperi* aperi, const char* cfgpath) {
+    const char* SUFFIX = ".compiled";
+    char* path = xmalloc(strlen(cfgpath) + strlen(SUFFIX) + 1);
+    stpcpy(stpcpy(path, cfgpath), SUFFIX);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    free(path);
+    if (fd < 0) return;
+    struct stat compiled, text;
+    size_t magic_ln = strlen(COMPILED_CONFIG_MAGIC);
+    int valid = fstat(fd, &compiled) == 0 && compiled.st_size > (off_t)magic_ln;
+    // a config edited after its compilation wins
+    if (valid && stat(cfgpath, &text) == 0) {
+        valid = text.st_mtim.tv_sec < compiled.st_mtim.tv_sec ||
+                (text.st_mtim.tv_sec == compiled.st_mtim.tv_sec &&
+                 text.st_mtim.tv_nsec <= compiled.st_mtim.tv_nsec);
+    }
+    if (valid) {
+        size_t size = compiled.st_size;
+        char* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED && memcmp(map, COMPILED_CONFIG_MAGIC, magic_ln) == 0) {
+            aperi->config_f = fmemopen(map + magic_ln, size - magic_ln, "r");
+        }
+        if (aperi->config_f) {
+            aperi->config_map = map;
+            aperi->config_map_size = size;
+        } else if (map != MAP_FAILED) {
+            munmap(map, size);
+        }
+    }
+    close(fd);
+}
+
 void aperi_close_config_file(Aperi* aperi) {
     if(aperi->config_f) fclose(aperi->config_f);
     aperi->config_f = NULL;
+    if (aperi->config_map) munmap(aperi->config_map, aperi->config_map_size);
+    aperi->config_map = NULL;
 }
 
 void aperi_check_for_wrapper_and_exec(Aperi *aperi) {
@@ -296,55 +762,37 @@ void aperi_check_for_wrapper_and_exec(Aperi *aperi) {
             char* argv[3];
             strcpy(ptr, c+1);
             argv[0] = wrapper_path;
-            argv[1] = xrealpath(aperi->file_path, NULL);
+            argv[1] = aperi->real_path;
             argv[2] = NULL;
+            if (aperi->query) {
+                if (access(wrapper_path, X_OK) == 0) aperi_print_command(aperi, argv);
+                continue;
+            }
+            PROBE1(aperi, wrapper_hit, wrapper_path);
             execvp(argv[0], argv);
             if (errno != ENOENT) {
                 fprintf(stderr, "Couldn't launch wrapper %s: %s\n", argv[0], strerror(errno));
             }
-            free(argv[1]);
         }
     }
     free(wrapper_path);
 }
 
 void aperi_launch_associated_app(Aperi* aperi) {
-    // first: search for a wrapper in the wrappers directory...
+    // first: the rules of the local override config, if any...
+    aperi_open_local_config(aperi);
+    while (aperi->config_f && aperi_find_rule(aperi)) {
+        aperi_read_app_and_launch(aperi);
+    }
+    aperi_close_config_file(aperi);
+    // ...then search for a wrapper in the wrappers directory...
     aperi_check_for_wrapper_and_exec(aperi);
     // if we are here no wrapper was found/worked. Continue with config file...
     aperi_open_config_file(aperi);
-    FILE* f = aperi->config_f;
-    if (!f) return;
-    int eof = 0;
-    while(!eof) {
-        int ch = getc(f);
-        ungetc(ch, f);
-        switch(ch) {
-            case '#':
-            case '\n':
-            case '\r':
-                // comment/empty line: skip to next valid line
-                next_line(f);
-                break;
-            case EOF:
-                eof = 1;
-                break;
-            default:
-            {
-                // check if the current line matches the rule
-                {
-                    int got_match = aperi_line_match(aperi);
-                    if (got_match) {
-                        // match: launch the associated program
-                        aperi_read_app_and_launch(aperi);
-                        break;
-                    } else {
-                        // no match: skip to next line
-                        aperi_read_line_to(aperi, '\n');
-                    }
-                }
-            }
-        }
+    if (!aperi->config_f) return;
+    // launch the associated program. If it can't be executed continue with the next rules
+    while (aperi_find_rule(aperi)) {
+        aperi_read_app_and_launch(aperi);
     }
     aperi_close_config_file(aperi);
 }
@@ -367,15 +815,23 @@ void aperi_read_app_and_launch(Aperi* aperi) {
     int used_str = 0;
     int curr_str = -1;
     int handle_placeholders = 0;
+    modifiers_free(&aperi->modifiers);
 
     // Read the config file one char at the time
     while(1) {
         ch = aperi_getc(aperi);
         if(ch == '\n' || ch == '\r' || ch == EOF) {
             break;
+        } else if (ch == '[' && !aperi->quoting && curr_arg < 0 && !handle_placeholders) {
+            aperi_read_modifiers(aperi);
+            continue;
         } else if (ch == '%' && !aperi->quoting && allocated_str == 0)  {
             handle_placeholders = 1;
             continue;
+        } else if (ch == '@' && !aperi->quoting && allocated_str == 0 && !handle_placeholders) {
+            free(argv);
+            aperi_launch_desktop_entry(aperi);
+            return;
         } else if (ch == ' ' && !aperi->quoting)  {
             // separator -> set new arg flag
             new_arg = 1;
@@ -407,14 +863,11 @@ void aperi_read_app_and_launch(Aperi* aperi) {
     }
 
     // expand real path or use arg as is if it's a url
-    if(!handle_placeholders) {
-        if (aperi->arg_type == ATURI) {
-            int pathlen = strlen(aperi->file_path);
-            argv[used_args-2] = xmalloc(pathlen+1);
-            strncpy(argv[used_args-2], aperi->file_path, pathlen+1);
-        } else {
-            argv[used_args-2] = xrealpath(aperi->file_path, NULL);
-        }
+    if (curr_arg < 0 && aperi->modifiers.set & MCopy) {
+        // no command: the rule only runs the built-in actions
+        argv[0] = NULL;
+    } else if(!handle_placeholders) {
+        argv[used_args-2] = strdup(aperi->real_path);
     } else {
         argv[used_args-2] = NULL;
     }
@@ -428,179 +881,310 @@ void aperi_read_app_and_launch(Aperi* aperi) {
     }
 
     // exec the program
-    execvp(argv[0], argv);
-    fprintf(stderr, "Error executing %s: %s\n", argv[0], strerror(errno));
+    aperi_exec(aperi, argv);
     for(int i = 0; i < used_args; ++i) free(argv[i]);
     free(argv);
 }
 
-void aperi_normalize_arg(Aperi* aperi, char** argp) {
-    char* arg = *argp;
-
-    int unescape = 0;
-    char* dest = arg;
-    char* new_arg = 0;
-    int first_f = true;
-    int extra_size = 0;
-    char* rp = 0;
-    while(*arg) {
-        if (*arg == '%' && !unescape) {
-            unescape = 1;
-        } else {
-            if (unescape) {
-                switch(*arg) {
-                    case 'f':
-                        {
-                            int original_sz = strlen(*argp)+1;
-                            if (first_f) {
-                                new_arg = xmalloc(original_sz);
-                                strcpy(new_arg, *argp);
-                                int offset_dest = dest - *argp;
-                                dest = new_arg + offset_dest;
-                                rp = xrealpath(aperi->file_path, NULL);
-                                if(!rp) {
-                                    perror("Error expanding real path");
-                                    exit(1);
-                                }
-                            }
-                            int len_rp = strlen(rp);
-                            // minus len of "%f" plus len of the real path
-                            extra_size += len_rp - 2;
-                            int offset_dest = dest - new_arg;
-                            new_arg = xrealloc(new_arg, original_sz+extra_size);
-                            dest = new_arg + offset_dest;
-                            strcpy(dest, rp);
-                            dest += len_rp;
-                            first_f = false;
-                        }
-                        break;
-                    case '%':
-                        *dest = *arg;
-                        ++dest;
-                        break;
-                }
-                unescape = 0;
-            } else {
-                *dest = *arg;
-                ++dest;
-            }
+void aperi_exec(Aperi* aperi, char** argv) {
+    char* exe = NULL;
+    if (argv[0]) {
+        exe = path_lookup(argv[0]);
+        if (!exe) {
+            fprintf(stderr, "Skipping rule: executable %s not found\n", argv[0]);
+            return;
         }
-        ++arg;
     }
-    *dest = 0;
-    if (new_arg) *argp = new_arg;
-    free(rp);
-    return;
+    if (aperi->query) {
+        // a rule without command has no command to report: the next rules are queried
+        if (!argv[0]) return;
+        aperi_print_command(aperi, argv);
+    }
+    if (aperi_run_actions(aperi, argv) != 0) {
+        fprintf(stderr, "Skipping rule: server of %s not live\n", argv[0]);
+        free(exe);
+        return;
+    }
+    if (aperi->modifiers.set & MPrefetch && aperi->arg_type == ATFile &&
+        S_ISREG(aperi->arg_stat.st_mode)) {
+        off_t length = aperi->modifiers.prefetch;
+        if (length > aperi->arg_stat.st_size) length = aperi->arg_stat.st_size;
+        // the absolute path: the cwd modifier may have changed the working directory
+        prefetch_file(aperi->real_path, length);
+    }
+    modifiers_apply(&aperi->modifiers);
+    PROBE2(aperi, exec, exe, argv[0]);
+    execv(exe, argv);
+    if (errno == ENOEXEC) {
+        // like execvp, run files without a recognized format with the shell
+        int argc = 0;
+        while (argv[argc]) ++argc;
+        char** sh_argv = xmalloc((argc + 2) * sizeof(char*));
+        sh_argv[0] = "sh";
+        sh_argv[1] = exe;
+        memcpy(&sh_argv[2], &argv[1], argc * sizeof(char*));
+        execv("/bin/sh", sh_argv);
+        free(sh_argv);
+    }
+    fprintf(stderr, "Error executing %s: %s\n", argv[0], strerror(errno));
+    // the next rules would inherit the limits, priorities and directory of this one
+    if (aperi->modifiers.set & (MProcess | MCwd)) exit(1);
+    free(exe);
 }
 
-void *xmalloc(size_t size) {
-    void* p = malloc(size);
-    if(!p) {
-        perror("Error allocating memory");
-        fprintf(stderr, "Aborting...\n");
-        exit(1);
+void aperi_read_modifiers(Aperi* aperi) {
+    int allocated = 32;
+    int ln = 0;
+    char* modifier = xmalloc(allocated);
+    while(1) {
+        int ch = aperi_getc(aperi);
+        if (ch == '\n' || ch == '\r' || ch == EOF) {
+            // no closing bracket: push the line end back for the caller
+            ungetc(ch, aperi->config_f);
+            fprintf(stderr, "Unterminated rule modifiers\n");
+        }
+        int end = ch == '\n' || ch == '\r' || ch == EOF || (ch == ']' && !aperi->quoting);
+        if (end || (ch == ' ' && !aperi->quoting)) {
+            modifier[ln] = 0;
+            if (ln && modifiers_parse(&aperi->modifiers, modifier) != 0) {
+                fprintf(stderr, "Ignoring invalid modifier %s\n", modifier);
+            }
+            ln = 0;
+            if (end) break;
+            continue;
+        }
+        if (ln + 2 > allocated) {
+            allocated *= 2;
+            modifier = xrealloc(modifier, allocated);
+        }
+        modifier[ln++] = ch;
     }
-    return p;
+    free(modifier);
 }
 
-void *xrealloc(void* p, size_t size) {
-    void* new_p = realloc(p, size);
-    if(!new_p) {
-        perror("Error reallocating memory");
-        fprintf(stderr, "Aborting...\n");
-        exit(1);
+void aperi_launch_desktop_entry(Aperi* aperi) {
+    int allocated = 64;
+    int ln = 0;
+    char* id = xmalloc(allocated);
+    while(1) {
+        int ch = aperi_getc(aperi);
+        if (ch == '\n' || ch == '\r' || ch == EOF) break;
+        if (ch == ' ' && !aperi->quoting) continue;
+        if (ln + 2 > allocated) {
+            allocated *= 2;
+            id = xrealloc(id, allocated);
+        }
+        id[ln++] = ch;
     }
-    return new_p;
-}
+    id[ln] = 0;
 
-char *xrealpath(const char *path, char *resolved_path) {
-    char *res = realpath(path, resolved_path);
-    if(!res) {
-        perror("Error in realpath");
+    DesktopEntry entry;
+    if (desktop_entry_lookup(id, &entry) != 0) {
+        fprintf(stderr, "Desktop entry %s not found\n", id);
+        free(id);
+        return;
     }
-    return res;
+    char** argv = desktop_entry_argv(&entry, aperi->real_path);
+    aperi->desktop_id = id;
+    aperi_exec(aperi, argv);
+    aperi->desktop_id = NULL;
+    desktop_argv_free(argv);
+    desktop_entry_free(&entry);
+    free(id);
 }
 
-void percent_decode(char* s) {
-    char* src = s;
-    char* dest = s;
-    // counter of digits to decode
-    int decode = 0;
-    // decoded char
-    char c;
-    while(*src) {
-        if (decode > 0) {
-            c = c << 4;
-            if ('0' <= *src && *src <= '9') c += *src - '0';
-            if ('A' <= *src && *src <= 'F') c += *src - 'A' + 10;
-            if ('a' <= *src && *src <= 'f') c += *src - 'a' + 10;
-            --decode;
-            if (decode == 0) {
-                *dest = c;
-                ++dest;
-            }
-        } else if(*src == '%') {
-            decode = 2;
-            c = 0;
-        } else {
-            *dest = *src;
-            ++dest;
+int aperi_run_actions(Aperi* aperi, char** argv) {
+    if (aperi->modifiers.set & MCopy) {
+        char* text = strdup(aperi->modifiers.copy);
+        aperi_normalize_arg(aperi, &text);
+        wlclip_copy(text);
+        free(text);
+    }
+    if (!argv[0]) exit(0);
+    if (aperi->modifiers.set & MServer && !(aperi->modifiers.set & MSocket)) {
+        fprintf(stderr, "Ignoring the server modifier without a socket modifier\n");
+    } else if (aperi->modifiers.set & MServer) {
+        warm_record_hit(aperi->modifiers.server, aperi->modifiers.socket);
+        if (server_ensure(aperi->modifiers.server, aperi->modifiers.socket) != 0) return 1;
+    }
+    if (aperi->modifiers.set & MCwd) {
+        char* dir = strdup(aperi->modifiers.cwd);
+        aperi_normalize_arg(aperi, &dir);
+        if (chdir(dir) != 0) {
+            fprintf(stderr, "Couldn't change directory to %s: %s\n", dir, strerror(errno));
         }
-        ++src;
+        free(dir);
     }
-    *dest = 0;
+    return 0;
 }
 
-int isdir(const char* path) {
-    struct stat statbuf;
-    return stat(path, &statbuf) == 0 && (statbuf.st_mode & S_IFMT) == S_IFDIR;
+void aperi_print_command(Aperi* aperi, char** argv) {
+    if (aperi->desktop_id) {
+        printf("@%s\n", aperi->desktop_id);
+        exit(0);
+    }
+    for (char** arg = argv; *arg; ++arg) {
+        char* quoted = shell_quote(*arg);
+        printf(arg == argv ? "%s" : " %s", quoted);
+        free(quoted);
+    }
+    printf("\n");
+    exit(0);
 }
 
-int next_line(FILE* f) {
-    int c;
-    while(1) {
-        c = getc(f);
-        if (c == '\n' || c == '\r' || c == EOF) break;
-    }
-    ungetc(c, f);
-    while(1) {
-        c = getc(f);
-        if (c != '\n' && c != '\r') break;
+char* aperi_show_items_path(const char* uri) {
+    size_t scheme_ln = strlen(SHOW_ITEMS_SCHEME);
+    if (strncmp(uri, SHOW_ITEMS_SCHEME, scheme_ln) != 0) return NULL;
+    char* path = strdup(uri + scheme_ln);
+    percent_decode(path);
+    char* res = lexical_path(path);
+    free(path);
+    return res;
+}
+
+char* aperi_placeholder(Aperi* aperi, char c) {
+    const char* local_path = aperi->local_path ? aperi->local_path : "";
+    // the last component of the local path (empty for the root and non local URIs)
+    const char* name = strrchr(local_path, '/');
+    name = name ? name + 1 : local_path;
+    switch(c) {
+        case 'f':
+            // absolute path (URIs are passed as they are)
+            return strdup(aperi->real_path);
+        case 'd':
+            // parent directory
+            if (name == local_path + 1) return strdup("/");
+            return strndup(local_path, name > local_path ? name - local_path - 1 : 0);
+        case 'n':
+            return strdup(name);
+        case 'q':
+            return shell_quote(name);
+        case '%':
+            return strdup("%");
     }
-    ungetc(c, f);
-    return 0;
+    return NULL;
 }
 
-const char* get_homedir() {
-    struct passwd *pw = getpwuid(getuid());
-    if (!pw) return "/";
-    return pw->pw_dir;
+void aperi_normalize_arg(Aperi* aperi, char** argp) {
+    const char* arg = *argp;
+    size_t allocated = strlen(arg) + 1;
+    size_t ln = 0;
+    char* res = xmalloc(allocated);
+    for (; *arg; ++arg) {
+        char literal[2] = {*arg, 0};
+        char* expansion = NULL;
+        const char* value = literal;
+        if (*arg == '%') {
+            // invalid placeholders and a trailing % expand to nothing
+            if (arg[1]) expansion = aperi_placeholder(aperi, *++arg);
+            value = expansion ? expansion : "";
+        }
+        size_t value_ln = strlen(value);
+        if (ln + value_ln + 1 > allocated) {
+            allocated = (ln + value_ln + 1) * 2;
+            res = xrealloc(res, allocated);
+        }
+        memcpy(res + ln, value, value_ln);
+        ln += value_ln;
+        free(expansion);
+    }
+    res[ln] = 0;
+    free(*argp);
+    *argp = res;
 }
 
-int strnicmp(const char* s1, const char* s2, size_t n) {
-    for (size_t i = 0; i < n; ++i) {
-        unsigned char c1 = tolower((unsigned char)s1[i]);
-        unsigned char c2 = tolower((unsigned char)s2[i]);
-        if(c1 != c2) {
-            return c1 < c2 ? -1 : 1;
+int aperi_warm(int n) {
+    Aperi aperi;
+    aperi.config_map = NULL;
+    modifiers_init(&aperi.modifiers);
+    aperi_init_config_dir_path(&aperi);
+    aperi_open_config_file(&aperi);
+    // server and socket modifiers of the server rules of the config
+    char** servers = NULL;
+    char** sockets = NULL;
+    int n_rules = 0;
+    while (aperi.config_f) {
+        int ch = aperi_getc(&aperi);
+        // skip the patterns of the rule, up to its command
+        while (ch != EOF && ch != '\n' && ch != '\r' && (aperi.quoting || ch != '=')) {
+            ch = aperi_getc(&aperi);
+        }
+        if (ch == EOF) break;
+        if (ch == '=' && (ch = aperi_getc(&aperi)) == '[' && !aperi.quoting) {
+            modifiers_free(&aperi.modifiers);
+            aperi_read_modifiers(&aperi);
+            if (aperi.modifiers.server && aperi.modifiers.socket) {
+                servers = xrealloc(servers, (n_rules + 1) * sizeof(char*));
+                sockets = xrealloc(sockets, (n_rules + 1) * sizeof(char*));
+                servers[n_rules] = strdup(aperi.modifiers.server);
+                sockets[n_rules++] = strdup(aperi.modifiers.socket);
+            }
         }
-        if (c1 == 0) break;
+        if (ch != '\n' && ch != '\r') aperi_read_line_to(&aperi, '\n');
+        aperi.quoting = 0;
     }
-    return 0;
+    int res = warm_start(n, servers, sockets, n_rules);
+    for (int i = 0; i < n_rules; ++i) {
+        free(servers[i]);
+        free(sockets[i]);
+    }
+    free(servers);
+    free(sockets);
+    aperi_close_config_file(&aperi);
+    free(aperi.config_dir_path);
+    modifiers_free(&aperi.modifiers);
+    return res;
 }
 
 int main(int argc, char* argv[]) {
+    // type of the content of the standard input (`--as <extension>`)
+    const char* type = NULL;
+    int query = 0;
+    if ((argc == 2 || argc == 3) && strcmp(argv[1], "--warm") == 0) {
+        int n = WARM_DEFAULT_SERVERS;
+        if (argc == 3 && (n = atoi(argv[2])) <= 0) {
+            fprintf(stderr, "Invalid number of servers %s\n", argv[2]);
+            return 1;
+        }
+        return aperi_warm(n);
+    }
+    if (argc == 3 && strcmp(argv[1], "--query") == 0) {
+        query = 1;
+        ++argv;
+        --argc;
+    } else if (argc == 4 && strcmp(argv[1], "--as") == 0 && strcmp(argv[3], "-") == 0) {
+        type = argv[2];
+        argv += 2;
+        argc -= 2;
+    }
     // No args: print help
     if (argc < 2) {
         printf("aperi version %s\n", VERSION);
+        // optional features of the build
+        printf("Built with:");
+#ifdef HAVE_ZLIB
+        printf(" zlib");
+#endif
+#ifdef HAVE_USDT
+        printf(" usdt");
+#endif
+#ifdef HAVE_DEFAULT_CONFIG
+        printf(" default_config");
+#endif
+        printf("\n");
         printf("Usage: %s <file>\n", argv[0]);
+        printf("       %s [--as <extension>] -\n", argv[0]);
+        printf("       %s --query <file>\n", argv[0]);
+        printf("       %s --warm [<number of servers>]\n", argv[0]);
         exit(0);
     }
 
     Aperi aperi;
-    aperi_init(&aperi, argv[1]);
+    aperi_init(&aperi, argv[1], type);
+    aperi.query = query;
     aperi_launch_associated_app(&aperi);
     aperi_deinit(&aperi);
 
-    return 0;
+    // --query: no command found
+    return query;
 }
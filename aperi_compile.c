@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "compiled_config.h"
+
+/* Config stripper.
+ *
+ * Strips an aperi config file of its comments and empty lines: only the rule lines are
+ * kept, with `\r` line ends normalized. aperi still parses them like the text config, but
+ * without reading the comments and, for the embedded rules, without any file I/O. The
+ * result is written either as a C header defining a static read-only array (`-c <name>`),
+ * embedded in aperi at build time as its lowest priority rules, or as a `.compiled` config
+ * file (the `COMPILED_CONFIG_MAGIC` line followed by the rules) that aperi maps in memory
+ * in place of `/etc/aperi/config`, like:
+ *
+ *  aperi_compile /etc/aperi/config /etc/aperi/config.compiled
+ *
+ * Usage: aperi_compile [-c <name>] <config> <output> */
+
+/* Read the rule lines of the config file `f` in `*rules` (to be freed). Lines without `=`
+ * are reported as warnings. Return the length of the rules. */
+static size_t read_rules(FILE* f, const char* path, char** rules);
+
+/* Write `rules` (`ln` bytes) to `f` as the C array `name` */
+static void write_header(FILE* f, const char* path, const char* name, const char* rules,
+                         size_t ln);
+
+static size_t read_rules(FILE* f, const char* path, char** rules) {
+    size_t allocated = 4096;
+    size_t ln = 0;
+    char* res = malloc(allocated);
+    if (!res) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    // start of the line being read in `res`
+    size_t line_start = 0;
+    int line_no = 1;
+    int ch;
+    do {
+        ch = getc(f);
+        // room for a character or a line end, and the terminator
+        if (ln + 2 > allocated) {
+            allocated *= 2;
+            res = realloc(res, allocated);
+            if (!res) {
+                fprintf(stderr, "Out of memory\n");
+                exit(1);
+            }
+        }
+        if (ch != EOF && ch != '\n' && ch != '\r') {
+            res[ln++] = ch;
+            continue;
+        }
+        // line end: keep the line only if it's a rule
+        char* line = res + line_start;
+        size_t line_ln = ln - line_start;
+        if (line_ln > 0 && line[0] != '#') {
+            if (!memchr(line, '=', line_ln)) {
+                fprintf(stderr, "%s:%d: warning: rule without '='\n", path, line_no);
+            }
+            res[ln++] = '\n';
+        } else {
+            ln = line_start;
+        }
+        line_start = ln;
+        if (ch == '\n') ++line_no;
+    } while (ch != EOF);
+    res[ln] = 0;
+    *rules = res;
+    return ln;
+}
+
+static void write_header(FILE* f, const char* path, const char* name, const char* rules,
+                         size_t ln) {
+    fprintf(f, "/* Generated by aperi_compile from %s: do not edit */\n", path);
+    fprintf(f, "static const char %s[] =\n    \"", name);
+    for (size_t i = 0; i < ln; ++i) {
+        unsigned char c = rules[i];
+        if (c == '\n') {
+            fprintf(f, i + 1 < ln ? "\\n\"\n    \"" : "\\n");
+        } else if (c == '"' || c == '\\' || c == '?') {
+            // '?' is escaped to avoid trigraphs
+            fprintf(f, "\\%c", c);
+        } else if (c < 0x20 || c >= 0x7f) {
+            fprintf(f, "\\%03o", c);
+        } else {
+            putc(c, f);
+        }
+    }
+    fprintf(f, "\";\n");
+}
+
+int main(int argc, char* argv[]) {
+    const char* name = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "c:")) != -1) {
+        if (opt == 'c') {
+            name = optarg;
+        } else {
+            optind = argc + 1;
+        }
+    }
+    if (argc - optind != 2) {
+        fprintf(stderr, "Usage: %s [-c <name>] <config> <output>\n", argv[0]);
+        return 2;
+    }
+    const char* path = argv[optind];
+    const char* output = argv[optind + 1];
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return 1;
+    }
+    char* rules;
+    size_t ln = read_rules(f, path, &rules);
+    fclose(f);
+
+    FILE* out = fopen(output, "wb");
+    if (!out) {
+        perror(output);
+        free(rules);
+        return 1;
+    }
+    if (name) {
+        write_header(out, path, name, rules, ln);
+    } else {
+        fputs(COMPILED_CONFIG_MAGIC, out);
+        fwrite(rules, 1, ln, out);
+    }
+    int res = ferror(out);
+    if (fclose(out) != 0 || res) {
+        fprintf(stderr, "Error writing %s\n", output);
+        res = 1;
+    }
+    free(rules);
+    return res;
+}
@@ -1,18 +1,123 @@
-#include <dbus/dbus.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/wait.h>
+#include "probes.h"
+#ifdef NATIVE_DBUS
+#include "minidbus.h"
+#else
+#include <dbus/dbus.h>
+#endif
 
+#define DBUS_NAME "org.freedesktop.FileManager1"
 #define DBUS_INTERFACE "org.freedesktop.FileManager1"
 #define DBUS_PATH "/org/freedesktop/FileManager1"
 #define SCHEMA "aperi-show-items"
 
+PROBE_SEMAPHORE(aperi_fm1, request_received);
+PROBE_SEMAPHORE(aperi_fm1, child_spawned);
+PROBE_SEMAPHORE(aperi_fm1, child_reaped);
+
+// Open the item `str` of a ShowItems call with aperi, if it's a file:// URI
+void show_item(const char* str) {
+    if (strncmp(str, "file://", 7) == 0) {
+        char* arg = malloc(strlen(str) + strlen(SCHEMA) - 4);
+        char* cp = stpcpy(arg, SCHEMA);
+        cp = stpcpy(cp, &str[4]);
+        // while traced, the intermediate process sends the pid of aperi through a pipe
+        int pids[2] = {-1, -1};
+        if (PROBE_ENABLED(aperi_fm1, child_spawned) && pipe(pids) != 0) pids[0] = -1;
+        pid_t pid = fork();
+        if (pid == 0) {
+            pid_t aperi = fork();
+            if (aperi == 0) {
+                char* argv[3];
+                argv[0] = "aperi";
+                argv[1] = arg;
+                argv[2] = NULL;
+                if (pids[0] >= 0) {
+                    close(pids[0]);
+                    close(pids[1]);
+                }
+                execvp(argv[0], argv);
+            }
+            if (pids[0] >= 0 && write(pids[1], &aperi, sizeof(aperi)) != sizeof(aperi)) {
+                exit(1);
+            }
+            exit(0);
+        }
+        if (pids[0] >= 0) {
+            close(pids[1]);
+            pid_t aperi = -1;
+            if (pid < 0 || read(pids[0], &aperi, sizeof(aperi)) != sizeof(aperi)) {
+                aperi = -1;
+            }
+            close(pids[0]);
+            PROBE2(aperi_fm1, child_spawned, aperi, arg);
+        }
+        free(arg);
+        int res;
+        waitpid(pid, &res, 0);
+        PROBE2(aperi_fm1, child_reaped, pid, res);
+    }
+}
+
+#ifdef NATIVE_DBUS
+
+int main(int argc, char** argv) {
+    MiniDBus bus;
+    // Connect to the session bus
+    if (minidbus_open_session(&bus) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    // Request the service name
+    uint32_t ret;
+    if (minidbus_request_name(&bus, DBUS_NAME, MINIDBUS_NAME_FLAG_REPLACE_EXISTING,
+                              &ret) != 0 || ret != MINIDBUS_NAME_PRIMARY_OWNER) {
+        minidbus_close(&bus);
+        return EXIT_FAILURE;
+    }
+
+    // Serve the method calls until the bus closes the connection
+    MiniDBusMessage msg;
+    while (minidbus_read(&bus, &msg) == 0) {
+        if (msg.type != MINIDBUS_METHOD_CALL) {
+            // signals (like NameAcquired) are ignored
+        } else if (msg.interface && strcmp(msg.interface, DBUS_INTERFACE) == 0 &&
+                   msg.member && strcmp(msg.member, "ShowItems") == 0) {
+            PROBE1(aperi_fm1, request_received, msg.serial);
+            const char** uris;
+            if (minidbus_read_string_array(&msg, &uris) != 0) {
+                fprintf(stderr, "Argument is not array!\n");
+            } else {
+                for (const char** uri = uris; *uri; ++uri) show_item(*uri);
+                free(uris);
+            }
+            minidbus_reply(&bus, &msg);
+        } else if (msg.interface && strcmp(msg.interface, "org.freedesktop.DBus.Peer") == 0 &&
+                   msg.member && strcmp(msg.member, "Ping") == 0) {
+            minidbus_reply(&bus, &msg);
+        } else {
+            minidbus_reply_error(&bus, &msg, "org.freedesktop.DBus.Error.UnknownMethod",
+                                 "Unknown method");
+        }
+        minidbus_message_free(&msg);
+    }
+    minidbus_close(&bus);
+    return EXIT_FAILURE;
+}
+
+#else
+
 // Function to handle ShowItems call
 DBusHandlerResult handle_method_call(DBusConnection* connection, DBusMessage* message,
                                      void* user_data) {
     if (dbus_message_is_method_call(message, DBUS_INTERFACE, "ShowItems")) {
+        if (PROBE_ENABLED(aperi_fm1, request_received)) {
+            PROBE1(aperi_fm1, request_received, dbus_message_get_serial(message));
+        }
         DBusMessageIter args;
         if (!dbus_message_iter_init(message, &args)) {
             fprintf(stderr, "Message has no arguments!\n");
@@ -25,25 +130,7 @@ DBusHandlerResult handle_method_call(DBusConnection* connection, DBusMessage* me
                 while (dbus_message_iter_get_arg_type(&sub_iter) == DBUS_TYPE_STRING) {
                     const char *str;
                     dbus_message_iter_get_basic(&sub_iter, &str);
-                    if (strncmp(str, "file://", 7) == 0) {
-                        char* arg = malloc(strlen(str) + strlen(SCHEMA) - 4);
-                        char* cp = stpcpy(arg, SCHEMA);
-                        cp = stpcpy(cp, &str[4]);
-                        pid_t pid = fork();
-                        if (pid == 0) {
-                            if (fork() == 0) {
-                                char* argv[3];
-                                argv[0] = "aperi";
-                                argv[1] = arg;
-                                argv[2] = NULL;
-                                execvp(argv[0], argv);
-                            }
-                            exit(0);
-                        }
-                        free(arg);
-                        int res;
-                        wait(&res);
-                    }
+                    show_item(str);
                     dbus_message_iter_next(&sub_iter);
                 }
             }
@@ -91,7 +178,7 @@ int main(int argc, char** argv) {
     }
 
     // Request the service name
-    ret = dbus_bus_request_name(connection, "org.freedesktop.FileManager1",
+    ret = dbus_bus_request_name(connection, DBUS_NAME,
                                 DBUS_NAME_FLAG_REPLACE_EXISTING, &error);
     if (dbus_error_is_set(&error)) {
         fprintf(stderr, "Name Error (%s)\n", error.message);
@@ -112,3 +199,4 @@ int main(int argc, char** argv) {
     return EXIT_SUCCESS;
 }
 
+#endif
@@ -0,0 +1,284 @@
+#define _GNU_SOURCE 1
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <dbus/dbus.h>
+#include "config.h"
+
+/* xdg-desktop-portal backend implementing org.freedesktop.impl.portal.AppChooser with
+ * aperi's rules.
+ *
+ * When a sandboxed application opens a file or URI without a default handler, the portal
+ * asks the AppChooser backend to pick one of the applications able to open it. Instead of
+ * showing a dialog, this backend asks `aperi --query` which command aperi would run for the
+ * file or URI and answers right away with:
+ *  - the desktop entry of the matching `=@<id>` rule, if it's among the choices;
+ *  - else aperi itself (`aperi.desktop`), if it's among the choices, so that aperi runs the
+ *    matching rule, wrapper or command;
+ *  - else the last choice made for the content type, if any, or the first choice.
+ *
+ * Usage: aperi_portal [<aperi executable>] */
+
+#define DBUS_NAME "org.freedesktop.impl.portal.desktop.aperi"
+#define DBUS_PATH "/org/freedesktop/portal/desktop"
+#define DBUS_INTERFACE "org.freedesktop.impl.portal.AppChooser"
+// portal response codes
+#define RESPONSE_SUCCESS 0
+#define RESPONSE_OTHER 2
+// maximum length of the `aperi --query` output read
+#define QUERY_MAX 4096
+// maximum time waited for `aperi --query` output, in ms: the calls are answered in order
+#define QUERY_TIMEOUT_MS 2000
+
+extern char** environ;
+
+// aperi executable, searched in PATH
+static const char* aperi = "aperi";
+
+/* Return the first line printed by `aperi --query <arg>` (to be freed), or NULL if aperi
+ * has no command for `arg` or doesn't answer within QUERY_TIMEOUT_MS */
+static char* query(const char* arg);
+
+/* Return 1 if `id` (with or without the `.desktop` suffix) is one of the `n` `choices` */
+static int has_choice(const char** choices, int n, const char* id);
+
+/* Return the choice for `arg` (a URI or a file name, NULL if unknown) among the `n`
+ * `choices`, or NULL if there's none. The result must be freed */
+static char* choose(const char* arg, const char** choices, int n, const char* last_choice);
+
+/* Append the option {`key`: <string `value`>} to the dictionary `dict` */
+static void append_string_option(DBusMessageIter* dict, const char* key, const char* value);
+
+/* Answer the ChooseApplication call `msg` */
+static void choose_application(DBusConnection* connection, DBusMessage* msg);
+
+/* Send `reply` (unreferencing it), exiting if the memory is exhausted */
+static void send_reply(DBusConnection* connection, DBusMessage* reply);
+
+static char* query(const char* arg) {
+    int fds[2];
+    if (pipe(fds)) return NULL;
+    char* argv[] = {(char*)aperi, "--query", (char*)arg, NULL};
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addclose(&actions, fds[0]);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addclose(&actions, fds[1]);
+    pid_t pid;
+    int res = posix_spawnp(&pid, aperi, &actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+    if (res) {
+        fprintf(stderr, "Couldn't start %s: %s\n", aperi, strerror(res));
+        close(fds[0]);
+        return NULL;
+    }
+    char* output = malloc(QUERY_MAX);
+    if (!output) {
+        fprintf(stderr, "No memory\n");
+        exit(1);
+    }
+    size_t ln = 0;
+    ssize_t n = -1;
+    struct pollfd pfd = {fds[0], POLLIN, 0};
+    while (ln < QUERY_MAX - 1 && poll(&pfd, 1, QUERY_TIMEOUT_MS) > 0 &&
+           (n = read(fds[0], output + ln, QUERY_MAX - 1 - ln)) > 0) {
+        ln += n;
+    }
+    close(fds[0]);
+    output[ln] = 0;
+    // no end of output: aperi is stuck (or too verbose), its answer is dropped
+    if (n != 0) {
+        kill(pid, SIGKILL);
+        ln = 0;
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || ln == 0) {
+        free(output);
+        return NULL;
+    }
+    output[strcspn(output, "\n")] = 0;
+    return output;
+}
+
+static int has_choice(const char** choices, int n, const char* id) {
+    size_t ln = strlen(id);
+    const char* SUFFIX = ".desktop";
+    size_t suffix_ln = strlen(SUFFIX);
+    if (ln > suffix_ln && strcmp(id + ln - suffix_ln, SUFFIX) == 0) ln -= suffix_ln;
+    for (int i = 0; i < n; ++i) {
+        if (strncmp(choices[i], id, ln) == 0 &&
+            (choices[i][ln] == 0 || strcmp(choices[i] + ln, SUFFIX) == 0)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static char* choose(const char* arg, const char** choices, int n, const char* last_choice) {
+    char* handler = arg ? query(arg) : NULL;
+    char* res = NULL;
+    if (handler && handler[0] == '@' && has_choice(choices, n, handler + 1)) {
+        res = strdup(handler + 1);
+        size_t ln = strlen(res);
+        if (ln > 8 && strcmp(res + ln - 8, ".desktop") == 0) res[ln - 8] = 0;
+    } else if (has_choice(choices, n, "aperi")) {
+        res = strdup("aperi");
+    } else if (last_choice && *last_choice && has_choice(choices, n, last_choice)) {
+        res = strdup(last_choice);
+    } else if (n > 0) {
+        res = strdup(choices[0]);
+    }
+    free(handler);
+    return res;
+}
+
+static void append_string_option(DBusMessageIter* dict, const char* key, const char* value) {
+    DBusMessageIter entry, variant;
+    dbus_message_iter_open_container(dict, DBUS_TYPE_DICT_ENTRY, NULL, &entry);
+    dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &key);
+    dbus_message_iter_open_container(&entry, DBUS_TYPE_VARIANT, DBUS_TYPE_STRING_AS_STRING,
+                                     &variant);
+    dbus_message_iter_append_basic(&variant, DBUS_TYPE_STRING, &value);
+    dbus_message_iter_close_container(&entry, &variant);
+    dbus_message_iter_close_container(dict, &entry);
+}
+
+static void send_reply(DBusConnection* connection, DBusMessage* reply) {
+    if (!reply || !dbus_connection_send(connection, reply, NULL)) {
+        fprintf(stderr, "No memory\n");
+        exit(1);
+    }
+    dbus_message_unref(reply);
+}
+
+static void choose_application(DBusConnection* connection, DBusMessage* msg) {
+    // arguments: handle, app_id, parent_window, choices, options
+    const char *handle, *app_id, *parent_window;
+    char** choices;
+    int n_choices;
+    DBusError error;
+    dbus_error_init(&error);
+    if (!dbus_message_get_args(msg, &error, DBUS_TYPE_OBJECT_PATH, &handle,
+                               DBUS_TYPE_STRING, &app_id, DBUS_TYPE_STRING, &parent_window,
+                               DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, &choices, &n_choices,
+                               DBUS_TYPE_INVALID)) {
+        send_reply(connection, dbus_message_new_error(msg, DBUS_ERROR_INVALID_ARGS,
+                                                      error.message));
+        dbus_error_free(&error);
+        return;
+    }
+
+    // options: the URI (or else the absolute file name) to open, the last choice and the
+    // activation token to hand back
+    const char *uri = NULL, *filename = NULL, *last_choice = NULL, *token = NULL;
+    DBusMessageIter args, dict;
+    dbus_message_iter_init(msg, &args);
+    for (int i = 0; i < 4; ++i) dbus_message_iter_next(&args);
+    if (dbus_message_iter_get_arg_type(&args) == DBUS_TYPE_ARRAY) {
+        dbus_message_iter_recurse(&args, &dict);
+        for (; dbus_message_iter_get_arg_type(&dict) == DBUS_TYPE_DICT_ENTRY;
+             dbus_message_iter_next(&dict)) {
+            DBusMessageIter entry, variant;
+            const char *key, *value;
+            dbus_message_iter_recurse(&dict, &entry);
+            dbus_message_iter_get_basic(&entry, &key);
+            dbus_message_iter_next(&entry);
+            dbus_message_iter_recurse(&entry, &variant);
+            if (dbus_message_iter_get_arg_type(&variant) != DBUS_TYPE_STRING) continue;
+            dbus_message_iter_get_basic(&variant, &value);
+            if (strcmp(key, "uri") == 0) uri = value;
+            else if (strcmp(key, "filename") == 0) filename = value;
+            else if (strcmp(key, "last_choice") == 0) last_choice = value;
+            else if (strcmp(key, "activation_token") == 0) token = value;
+        }
+    }
+
+    // the file name option is a bare name, relative to nothing known here: only URIs and
+    // absolute paths are queried
+    const char* arg = uri && strstr(uri, "://") ? uri : NULL;
+    if (!arg && filename && filename[0] == '/') arg = filename;
+    char* choice = choose(arg, (const char**)choices, n_choices, last_choice);
+    dbus_uint32_t response = choice ? RESPONSE_SUCCESS : RESPONSE_OTHER;
+    DBusMessage* reply = dbus_message_new_method_return(msg);
+    if (reply) {
+        DBusMessageIter reply_args, results;
+        dbus_message_iter_init_append(reply, &reply_args);
+        dbus_message_iter_append_basic(&reply_args, DBUS_TYPE_UINT32, &response);
+        dbus_message_iter_open_container(&reply_args, DBUS_TYPE_ARRAY,
+                                         DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+                                         DBUS_TYPE_STRING_AS_STRING
+                                         DBUS_TYPE_VARIANT_AS_STRING
+                                         DBUS_DICT_ENTRY_END_CHAR_AS_STRING, &results);
+        if (choice) append_string_option(&results, "choice", choice);
+        if (choice && token) append_string_option(&results, "activation_token", token);
+        dbus_message_iter_close_container(&reply_args, &results);
+    }
+    send_reply(connection, reply);
+    free(choice);
+    dbus_free_string_array(choices);
+}
+
+// Function to handle the AppChooser calls
+DBusHandlerResult handle_method_call(DBusConnection* connection, DBusMessage* message,
+                                     void* user_data) {
+    if (!dbus_message_has_path(message, DBUS_PATH)) {
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    }
+    if (dbus_message_is_method_call(message, DBUS_INTERFACE, "ChooseApplication")) {
+        choose_application(connection, message);
+        return DBUS_HANDLER_RESULT_HANDLED;
+    }
+    if (dbus_message_is_method_call(message, DBUS_INTERFACE, "UpdateChoices")) {
+        // the choice was already made: nothing to update
+        send_reply(connection, dbus_message_new_method_return(message));
+        return DBUS_HANDLER_RESULT_HANDLED;
+    }
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 2 || (argc == 2 && argv[1][0] == '-')) {
+        fprintf(stdout, "aperi_portal version %s\n", VERSION);
+        fprintf(stdout, "Usage: %s [<aperi executable>]\n", argv[0]);
+        exit(0);
+    }
+    if (argc == 2) aperi = argv[1];
+
+    DBusError error;
+    dbus_error_init(&error);
+
+    // Connect to the session bus
+    DBusConnection* connection = dbus_bus_get(DBUS_BUS_SESSION, &error);
+    if (dbus_error_is_set(&error)) {
+        fprintf(stderr, "Connection Error (%s)\n", error.message);
+        dbus_error_free(&error);
+        return EXIT_FAILURE;
+    }
+    if (connection == NULL) {
+        return EXIT_FAILURE;
+    }
+
+    // Request the service name
+    int ret = dbus_bus_request_name(connection, DBUS_NAME, DBUS_NAME_FLAG_REPLACE_EXISTING,
+                                    &error);
+    if (dbus_error_is_set(&error)) {
+        fprintf(stderr, "Name Error (%s)\n", error.message);
+        dbus_error_free(&error);
+        return EXIT_FAILURE;
+    }
+    if (ret != DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER) {
+        return EXIT_FAILURE;
+    }
+
+    // Add a filter for the method calls
+    dbus_connection_add_filter(connection, handle_method_call, NULL, NULL);
+    while (dbus_connection_read_write_dispatch(connection, -1)) {}
+    return EXIT_SUCCESS;
+}
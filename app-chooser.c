@@ -1,3 +1,4 @@
+#define _GNU_SOURCE 1
 #include <fcntl.h>
 #include <stdio.h>
 #include <errno.h>
@@ -5,9 +6,490 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <unistd.h>
+#include <pwd.h>
+#include <sys/stat.h>
 #include <dbus/dbus.h>
 #include "config.h"
 
+#define PORTAL_BUS_NAME "org.freedesktop.portal.Desktop"
+#define PORTAL_PATH "/org/freedesktop/portal/desktop"
+#define PORTAL_REQUEST_INTERFACE "org.freedesktop.portal.Request"
+#define PERMISSION_STORE_BUS_NAME "org.freedesktop.impl.portal.PermissionStore"
+#define PERMISSION_STORE_PATH "/org/freedesktop/impl/portal/PermissionStore"
+#define PERMISSION_STORE_INTERFACE "org.freedesktop.impl.portal.PermissionStore"
+// Permission store table where the portal records the application chosen for each
+// content type
+#define USED_APPS_TABLE "desktop-used-apps"
+
+// Growable string
+
+typedef struct Str {
+    char* s;
+    size_t len;
+    size_t allocated;
+} Str;
+
+/* Initialize `str` to an empty string */
+void str_init(Str* str);
+
+/* Append the character `c` to `str` */
+void str_putc(Str* str, char c);
+
+/* Append the string `s` to `str` */
+void str_append(Str* str, const char* s);
+
+// Portal request state
+
+typedef struct Chooser {
+    // object path of the portal Request whose Response we are waiting for
+    char* request_path;
+    // set when the request is over (Response received or error)
+    int done;
+    // portal response code: 0 success, 1 cancelled by the user, 2 other error
+    dbus_uint32_t response;
+} Chooser;
+
+// Application chosen for a content type, as recorded by the portal permission store
+typedef struct UsedApp {
+    char* content_type;
+    char* app_id;
+    char* count;
+} UsedApp;
+
+typedef struct UsedApps {
+    UsedApp* apps;
+    int n;
+} UsedApps;
+
+/* Take a snapshot of the applications the portal remembers for each content type. The
+ * snapshot is empty if the permission store is not available. */
+void used_apps_snapshot(DBusConnection* conn, UsedApps* snap);
+
+/* Free the memory allocated by used_apps_snapshot() */
+void used_apps_free(UsedApps* snap);
+
+/* Compare two snapshots taken before and after a choice and return the id of the
+ * application the user picked for one of the `n_types` content types `types`, or NULL if
+ * none of them changed. */
+const char* used_apps_chosen(const UsedApps* before, const UsedApps* after,
+                             char* const* types, int n_types);
+
+/* Return the aperi rule matching `arg` (`<scheme>://` for URIs, the extension for files)
+ * or NULL if there's none. The result must be freed. */
+char* rule_pattern(const char* arg, int has_schema);
+
+/* Set `*types` to the content types the portal can record the choice for the rule
+ * `pattern` under: `x-scheme-handler/<scheme>` for URIs, the types with the glob
+ * `*.<extension>` in the shared-mime-info globs2 files for files. Return their number.
+ * The types must be freed with free_strings(). */
+int content_types(const char* pattern, int has_schema, char*** types);
+
+/* Add the types of the `*.<ext>` glob in the globs2 file `path` to `*types` */
+void globs_content_types(const char* path, const char* ext, char*** types, int* n);
+
+/* Free the `n` strings of `strings` and the array */
+void free_strings(char** strings, int n);
+
+/* Insert the rule `pattern=@<app_id>.desktop` in the user config file before the first
+ * catch all rule. Return 0 on success. */
+int learn_rule(const char* pattern, const char* app_id);
+
+// Utility functions
+
+/* Send `msg` (unreferencing it) and block until its reply. Return NULL on errors. */
+DBusMessage* call_method(DBusConnection* conn, DBusMessage* msg);
+
+/* Append the option {`key`: <variant of `type`>} to the dictionary `dict` */
+void append_option(DBusMessageIter* dict, const char* key, int type, const char* sig,
+                   const void* value);
+
+/* return a pointer to a string containing the current user home directory.
+ * The string must not be modified or freed */
+const char* get_homedir();
+
+// Implementation
+
+void str_init(Str* str) {
+    str->s = NULL;
+    str->len = 0;
+    str->allocated = 0;
+    str_putc(str, 0);
+    str->len = 0;
+}
+
+void str_putc(Str* str, char c) {
+    if (str->len + 2 > str->allocated) {
+        str->allocated = str->allocated ? str->allocated * 2 : 64;
+        str->s = realloc(str->s, str->allocated);
+        if (!str->s) {
+            fprintf(stderr, "Out Of Memory!\n");
+            exit(1);
+        }
+    }
+    str->s[str->len++] = c;
+    str->s[str->len] = 0;
+}
+
+void str_append(Str* str, const char* s) {
+    for (; *s; ++s) str_putc(str, *s);
+}
+
+static void open_reply_notify(DBusPendingCall* pending, void* user_data) {
+    Chooser* chooser = user_data;
+    DBusMessage* reply = dbus_pending_call_steal_reply(pending);
+    if (!reply) {
+        fprintf(stderr, "Reply Null\n");
+        chooser->response = 2;
+        chooser->done = 1;
+        return;
+    }
+    if (dbus_message_get_type(reply) == DBUS_MESSAGE_TYPE_ERROR) {
+        DBusError err;
+        dbus_error_init(&err);
+        dbus_set_error_from_message(&err, reply);
+        fprintf(stderr, "Portal Error (%s)\n", err.message);
+        dbus_error_free(&err);
+        chooser->response = 2;
+        chooser->done = 1;
+    } else {
+        // Older portals ignore handle_token: follow the request path they return
+        const char* handle;
+        if (dbus_message_get_args(reply, NULL, DBUS_TYPE_OBJECT_PATH, &handle,
+                                  DBUS_TYPE_INVALID) &&
+            strcmp(handle, chooser->request_path) != 0) {
+            free(chooser->request_path);
+            chooser->request_path = strdup(handle);
+        }
+    }
+    dbus_message_unref(reply);
+}
+
+static DBusHandlerResult response_filter(DBusConnection* conn, DBusMessage* msg,
+                                         void* user_data) {
+    Chooser* chooser = user_data;
+    if (dbus_message_is_signal(msg, PORTAL_REQUEST_INTERFACE, "Response") &&
+        strcmp(dbus_message_get_path(msg), chooser->request_path) == 0) {
+        dbus_uint32_t response = 2;
+        dbus_message_get_args(msg, NULL, DBUS_TYPE_UINT32, &response, DBUS_TYPE_INVALID);
+        chooser->response = response;
+        chooser->done = 1;
+        return DBUS_HANDLER_RESULT_HANDLED;
+    }
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+void used_apps_snapshot(DBusConnection* conn, UsedApps* snap) {
+    snap->apps = NULL;
+    snap->n = 0;
+    const char* table = USED_APPS_TABLE;
+    DBusMessage* msg = dbus_message_new_method_call(PERMISSION_STORE_BUS_NAME,
+                                                    PERMISSION_STORE_PATH,
+                                                    PERMISSION_STORE_INTERFACE, "List");
+    if (!msg) return;
+    dbus_message_append_args(msg, DBUS_TYPE_STRING, &table, DBUS_TYPE_INVALID);
+    DBusMessage* reply = call_method(conn, msg);
+    if (!reply) return;
+    char** ids;
+    int n_ids;
+    if (!dbus_message_get_args(reply, NULL, DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, &ids, &n_ids,
+                               DBUS_TYPE_INVALID)) {
+        dbus_message_unref(reply);
+        return;
+    }
+    dbus_message_unref(reply);
+    snap->apps = calloc(n_ids ? n_ids : 1, sizeof(UsedApp));
+    if (!snap->apps) {
+        fprintf(stderr, "Out Of Memory!\n");
+        exit(1);
+    }
+    for (int i = 0; i < n_ids; ++i) {
+        msg = dbus_message_new_method_call(PERMISSION_STORE_BUS_NAME, PERMISSION_STORE_PATH,
+                                           PERMISSION_STORE_INTERFACE, "Lookup");
+        if (!msg) break;
+        dbus_message_append_args(msg, DBUS_TYPE_STRING, &table, DBUS_TYPE_STRING, &ids[i],
+                                 DBUS_TYPE_INVALID);
+        reply = call_method(conn, msg);
+        if (!reply) continue;
+        // (a{sas}v): permissions per calling application. Unsandboxed callers like us
+        // are stored with an empty app id and the value [chosen app, count, ...]
+        DBusMessageIter args, dict, entry, perms;
+        if (dbus_message_iter_init(reply, &args) &&
+            dbus_message_iter_get_arg_type(&args) == DBUS_TYPE_ARRAY) {
+            dbus_message_iter_recurse(&args, &dict);
+            while (dbus_message_iter_get_arg_type(&dict) == DBUS_TYPE_DICT_ENTRY) {
+                const char* caller;
+                dbus_message_iter_recurse(&dict, &entry);
+                dbus_message_iter_get_basic(&entry, &caller);
+                dbus_message_iter_next(&entry);
+                if (caller[0] == 0 &&
+                    dbus_message_iter_get_arg_type(&entry) == DBUS_TYPE_ARRAY) {
+                    const char* app_id = NULL;
+                    const char* count = "";
+                    dbus_message_iter_recurse(&entry, &perms);
+                    if (dbus_message_iter_get_arg_type(&perms) == DBUS_TYPE_STRING) {
+                        dbus_message_iter_get_basic(&perms, &app_id);
+                        dbus_message_iter_next(&perms);
+                    }
+                    if (dbus_message_iter_get_arg_type(&perms) == DBUS_TYPE_STRING) {
+                        dbus_message_iter_get_basic(&perms, &count);
+                    }
+                    if (app_id) {
+                        UsedApp* app = &snap->apps[snap->n++];
+                        app->content_type = strdup(ids[i]);
+                        app->app_id = strdup(app_id);
+                        app->count = strdup(count);
+                    }
+                    break;
+                }
+                dbus_message_iter_next(&dict);
+            }
+        }
+        dbus_message_unref(reply);
+    }
+    dbus_free_string_array(ids);
+}
+
+void used_apps_free(UsedApps* snap) {
+    for (int i = 0; i < snap->n; ++i) {
+        free(snap->apps[i].content_type);
+        free(snap->apps[i].app_id);
+        free(snap->apps[i].count);
+    }
+    free(snap->apps);
+    snap->apps = NULL;
+    snap->n = 0;
+}
+
+const char* used_apps_chosen(const UsedApps* before, const UsedApps* after,
+                             char* const* types, int n_types) {
+    // the portal bumps the counter (or replaces the app) of the chosen content type
+    for (int i = 0; i < after->n; ++i) {
+        const UsedApp* a = &after->apps[i];
+        int ours = 0;
+        for (int t = 0; t < n_types && !ours; ++t) {
+            ours = strcmp(a->content_type, types[t]) == 0;
+        }
+        // other content types may change meanwhile (like choices made by other apps)
+        if (!ours) continue;
+        int changed = 1;
+        for (int j = 0; j < before->n; ++j) {
+            const UsedApp* b = &before->apps[j];
+            if (strcmp(a->content_type, b->content_type) == 0) {
+                changed = strcmp(a->app_id, b->app_id) != 0 || strcmp(a->count, b->count) != 0;
+                break;
+            }
+        }
+        if (changed) return a->app_id;
+    }
+    return NULL;
+}
+
+char* rule_pattern(const char* arg, int has_schema) {
+    if (has_schema) {
+        const char* end = strstr(arg, "://");
+        return strndup(arg, end - arg + 3);
+    }
+    const char* basename = strrchr(arg, '/');
+    basename = basename ? basename + 1 : arg;
+    const char* dot = strrchr(basename, '.');
+    // no extension, or a hidden file without one
+    if (!dot || dot == basename || dot[1] == 0) return NULL;
+    return strdup(dot + 1);
+}
+
+int content_types(const char* pattern, int has_schema, char*** types) {
+    *types = NULL;
+    int n = 0;
+    if (has_schema) {
+        *types = malloc(sizeof(char*));
+        if (!*types || asprintf(&(*types)[0], "x-scheme-handler/%.*s",
+                                (int)(strlen(pattern) - 3), pattern) < 0) {
+            fprintf(stderr, "Out Of Memory!\n");
+            exit(1);
+        }
+        return 1;
+    }
+    // the data dirs, starting from the user one
+    Str dirs;
+    str_init(&dirs);
+    const char* data_home = getenv("XDG_DATA_HOME");
+    if (data_home && *data_home) {
+        str_append(&dirs, data_home);
+    } else {
+        str_append(&dirs, get_homedir());
+        str_append(&dirs, "/.local/share");
+    }
+    const char* data_dirs = getenv("XDG_DATA_DIRS");
+    str_putc(&dirs, ':');
+    str_append(&dirs, data_dirs && *data_dirs ? data_dirs : "/usr/local/share:/usr/share");
+    char* save;
+    for (char* dir = strtok_r(dirs.s, ":", &save); dir; dir = strtok_r(NULL, ":", &save)) {
+        char* path;
+        if (asprintf(&path, "%s/mime/globs2", dir) < 0) continue;
+        globs_content_types(path, pattern, types, &n);
+        free(path);
+    }
+    free(dirs.s);
+    return n;
+}
+
+void globs_content_types(const char* path, const char* ext, char*** types, int* n) {
+    FILE* f = fopen(path, "r");
+    if (!f) return;
+    char* line = NULL;
+    size_t allocated = 0;
+    ssize_t ln;
+    // lines `<weight>:<type>:<glob>[:<flags>]`
+    while ((ln = getline(&line, &allocated, f)) >= 0) {
+        if (ln > 0 && line[ln - 1] == '\n') line[ln - 1] = 0;
+        if (line[0] == '#') continue;
+        char* type = strchr(line, ':');
+        char* glob = type ? strchr(type + 1, ':') : NULL;
+        if (!glob) continue;
+        *type++ = 0;
+        *glob++ = 0;
+        char* flags = strchr(glob, ':');
+        if (flags) *flags++ = 0;
+        // globs are case insensitive unless flagged `cs`
+        int cs = flags && strstr(flags, "cs") != NULL;
+        if (glob[0] != '*' || glob[1] != '.' ||
+            (cs ? strcmp(glob + 2, ext) : strcasecmp(glob + 2, ext)) != 0) {
+            continue;
+        }
+        int known = 0;
+        for (int i = 0; i < *n && !known; ++i) known = strcmp((*types)[i], type) == 0;
+        if (known) continue;
+        *types = realloc(*types, (*n + 1) * sizeof(char*));
+        if (!*types || !((*types)[*n] = strdup(type))) {
+            fprintf(stderr, "Out Of Memory!\n");
+            exit(1);
+        }
+        ++*n;
+    }
+    free(line);
+    fclose(f);
+}
+
+void free_strings(char** strings, int n) {
+    for (int i = 0; i < n; ++i) free(strings[i]);
+    free(strings);
+}
+
+int learn_rule(const char* pattern, const char* app_id) {
+    char* cfgpath;
+    const char* xdg_config_home = getenv("XDG_CONFIG_HOME");
+    int ln;
+    if (xdg_config_home) {
+        ln = asprintf(&cfgpath, "%s/aperi/config", xdg_config_home);
+    } else {
+        ln = asprintf(&cfgpath, "%s/.config/aperi/config", get_homedir());
+    }
+    if (ln < 0) return 1;
+    // the config is replaced by a rename: write next to the target of a symlinked config,
+    // which stays a symlink
+    char* target = realpath(cfgpath, NULL);
+    free(cfgpath);
+    if (!target) return 1;
+    cfgpath = target;
+
+    // only update an existing user configuration: creating one would hide /etc/aperi
+    struct stat statbuf;
+    FILE* f = fopen(cfgpath, "r");
+    if (!f || fstat(fileno(f), &statbuf) != 0) {
+        if (f) fclose(f);
+        free(cfgpath);
+        return 1;
+    }
+
+    char* tmppath;
+    if (asprintf(&tmppath, "%s.XXXXXX", cfgpath) < 0) {
+        fclose(f);
+        free(cfgpath);
+        return 1;
+    }
+    int fd = mkstemp(tmppath);
+    FILE* out = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (!out) {
+        if (fd >= 0) close(fd);
+        fclose(f);
+        free(cfgpath);
+        free(tmppath);
+        return 1;
+    }
+    fchmod(fd, statbuf.st_mode & 07777);
+
+    Str rule;
+    str_init(&rule);
+    str_append(&rule, "# Learned by app-chooser\n");
+    int quote = strpbrk(pattern, ",=\"") != NULL;
+    if (quote) str_putc(&rule, '"');
+    for (const char* c = pattern; *c; ++c) {
+        if (*c == '"') str_putc(&rule, '"');
+        str_putc(&rule, *c);
+    }
+    if (quote) str_putc(&rule, '"');
+    str_append(&rule, "=@");
+    str_append(&rule, app_id);
+    str_append(&rule, ".desktop\n");
+
+    char* line = NULL;
+    size_t allocated = 0;
+    ssize_t n;
+    int inserted = 0;
+    int last_newline = 1;
+    while ((n = getline(&line, &allocated, f)) > 0) {
+        if (!inserted && strncmp(line, "/*", 2) == 0 && (line[2] == ',' || line[2] == '=')) {
+            fputs(rule.s, out);
+            inserted = 1;
+        }
+        fputs(line, out);
+        last_newline = line[n-1] == '\n';
+    }
+    if (!inserted) {
+        if (!last_newline) fputc('\n', out);
+        fputs(rule.s, out);
+    }
+    free(line);
+    free(rule.s);
+    fclose(f);
+
+    int res = fclose(out) != 0 || rename(tmppath, cfgpath) != 0;
+    if (res) unlink(tmppath);
+    free(tmppath);
+    free(cfgpath);
+    return res;
+}
+
+DBusMessage* call_method(DBusConnection* conn, DBusMessage* msg) {
+    DBusError err;
+    dbus_error_init(&err);
+    DBusMessage* reply = dbus_connection_send_with_reply_and_block(conn, msg,
+                                                                   DBUS_TIMEOUT_USE_DEFAULT,
+                                                                   &err);
+    dbus_message_unref(msg);
+    if (dbus_error_is_set(&err)) dbus_error_free(&err);
+    return reply;
+}
+
+void append_option(DBusMessageIter* dict, const char* key, int type, const char* sig,
+                   const void* value) {
+    DBusMessageIter entry, variant;
+    dbus_message_iter_open_container(dict, DBUS_TYPE_DICT_ENTRY, NULL, &entry);
+    dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &key);
+    dbus_message_iter_open_container(&entry, DBUS_TYPE_VARIANT, sig, &variant);
+    dbus_message_iter_append_basic(&variant, type, value);
+    dbus_message_iter_close_container(&entry, &variant);
+    dbus_message_iter_close_container(dict, &entry);
+}
+
+const char* get_homedir() {
+    const char* home = getenv("HOME");
+    if (home && *home) return home;
+    struct passwd *pw = getpwuid(getuid());
+    if (!pw) return "/";
+    return pw->pw_dir;
+}
+
 int main(int argc, char* argv[]) {
     if (argc < 2) {
         fprintf(stdout, "app-chooser version %s\n", VERSION);
@@ -33,7 +515,7 @@ int main(int argc, char* argv[]) {
 
     int has_schema = strstr(argv[1], "://") != NULL;
 
-    int fh;
+    int fh = -1;
     if (!has_schema) {
         // open the passed file
         fh = open(argv[1], O_RDONLY);
@@ -43,12 +525,40 @@ int main(int argc, char* argv[]) {
         }
     }
 
+    // Remember what the portal knows before asking, to find out later what was chosen
+    char* pattern = rule_pattern(argv[1], has_schema);
+    UsedApps before = {0};
+    if (pattern) used_apps_snapshot(conn, &before);
+
+    /* Subscribe to the Response signal of the request before making the call, so that it
+     * can't be missed. The request path is derived from our unique name and the
+     * handle_token option. */
+    Chooser chooser = {0};
+    char handle_token[32];
+    snprintf(handle_token, sizeof(handle_token), "aperi%d", (int)getpid());
+    char* sender = strdup(dbus_bus_get_unique_name(conn) + 1);
+    for (char* c = sender; *c; ++c) {
+        if (*c == '.') *c = '_';
+    }
+    if (asprintf(&chooser.request_path, PORTAL_PATH "/request/%s/%s", sender,
+                 handle_token) < 0) {
+        fprintf(stderr, "Out Of Memory!\n");
+        exit(1);
+    }
+    free(sender);
+    dbus_bus_add_match(conn, "type='signal',interface='" PORTAL_REQUEST_INTERFACE "',"
+                             "member='Response'", &err);
+    if (dbus_error_is_set(&err)) {
+        fprintf(stderr, "Match Error (%s)\n", err.message);
+        exit(1);
+    }
+    dbus_connection_add_filter(conn, response_filter, &chooser, NULL);
+
     // Create the message for the call
     DBusMessage* msg;
     DBusMessageIter args;
     DBusPendingCall* pending;
-    msg = dbus_message_new_method_call("org.freedesktop.portal.Desktop",
-                                       "/org/freedesktop/portal/desktop",
+    msg = dbus_message_new_method_call(PORTAL_BUS_NAME, PORTAL_PATH,
                                        "org.freedesktop.portal.OpenURI",
                                        has_schema ? "OpenURI" : "OpenFile");
     if (!msg) {
@@ -79,50 +589,59 @@ int main(int argc, char* argv[]) {
         }
     }
 
-    // Dictionary of options {string: variant}
-    DBusMessageIter iterDict, iterEntry, iterValue;
+    // Dictionary of options {string: variant}: ask=true and our handle_token
+    DBusMessageIter iterDict;
     dbus_message_iter_open_container(&args, DBUS_TYPE_ARRAY,
                                      DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
                                      DBUS_TYPE_STRING_AS_STRING DBUS_TYPE_VARIANT_AS_STRING
                                      DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
                                      &iterDict);
-    // Add the option "ask=true"
-    dbus_message_iter_open_container(&iterDict, DBUS_TYPE_DICT_ENTRY, NULL, &iterEntry);
-    char *key = "ask";
-    dbus_message_iter_append_basic(&iterEntry, DBUS_TYPE_STRING, &key);
-    dbus_message_iter_open_container(&iterEntry, DBUS_TYPE_VARIANT,
-                                     DBUS_TYPE_BOOLEAN_AS_STRING, &iterValue);
-    int val = 1;
-    dbus_message_iter_append_basic(&iterValue, DBUS_TYPE_BOOLEAN, &val);
-    dbus_message_iter_close_container(&iterEntry, &iterValue);
-    dbus_message_iter_close_container(&iterDict, &iterEntry);
+    dbus_bool_t ask = 1;
+    append_option(&iterDict, "ask", DBUS_TYPE_BOOLEAN, DBUS_TYPE_BOOLEAN_AS_STRING, &ask);
+    const char* token = handle_token;
+    append_option(&iterDict, "handle_token", DBUS_TYPE_STRING, DBUS_TYPE_STRING_AS_STRING,
+                  &token);
     dbus_message_iter_close_container(&args, &iterDict);
 
-    // Call the method
-    if (!dbus_connection_send_with_reply (conn, msg, &pending, -1)) {
+    // Call the method without blocking: the reply only carries the request handle, the
+    // outcome arrives later with the Response signal
+    if (!dbus_connection_send_with_reply(conn, msg, &pending, DBUS_TIMEOUT_INFINITE)) {
         fprintf(stderr, "Out Of Memory!\n");
         exit(1);
     }
-
+    dbus_message_unref(msg);
     if (!pending) {
         fprintf(stderr, "Pending Call Null\n");
         exit(1);
     }
+    dbus_pending_call_set_notify(pending, open_reply_notify, &chooser, NULL);
 
-    // Block until the call is completed
-    dbus_pending_call_block(pending);
-    // get the reply message
-    msg = dbus_pending_call_steal_reply(pending);
-    if (NULL == msg) {
-        fprintf(stderr, "Reply Null\n"); 
-        exit(1); 
-    }
-    // free the pending message handle
+    while (!chooser.done && dbus_connection_read_write_dispatch(conn, -1)) {}
     dbus_pending_call_unref(pending);
-    dbus_connection_flush(conn);
+    if (fh >= 0) close(fh);
 
-    // free message
-    dbus_message_unref(msg);
-    close(fh);
-    return 0;
+    // Learn the choice as an aperi rule, so the chooser isn't needed next time
+    int res = chooser.response == 0 ? 0 : 1;
+    if (chooser.response == 0 && pattern) {
+        UsedApps after;
+        used_apps_snapshot(conn, &after);
+        char** types;
+        int n_types = content_types(pattern, has_schema, &types);
+        const char* app_id = used_apps_chosen(&before, &after, types, n_types);
+        if (app_id) {
+            if (learn_rule(pattern, app_id) == 0) {
+                printf("Added rule %s=@%s.desktop\n", pattern, app_id);
+            } else {
+                fprintf(stderr, "Couldn't add rule for %s to the user config file\n",
+                        pattern);
+            }
+        }
+        used_apps_free(&after);
+        free_strings(types, n_types);
+    }
+    used_apps_free(&before);
+    free(pattern);
+    free(chooser.request_path);
+    dbus_connection_flush(conn);
+    return res;
 }
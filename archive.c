@@ -0,0 +1,581 @@
+#define _GNU_SOURCE 1
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "config.h"
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#include "archive.h"
+#include "util.h"
+
+// Cache subdirectory (in $XDG_CACHE_HOME/aperi) of the extracted members
+#define ARCHIVES_DIR "archives"
+#define DEFAULT_CACHE_SIZE "1G"
+#define COPY_BUFFER 65536
+
+// zip signatures and record sizes
+#define ZIP_EOCD_SIGNATURE 0x06054b50
+#define ZIP_CD_SIGNATURE 0x02014b50
+#define ZIP_LOCAL_SIGNATURE 0x04034b50
+#define ZIP_EOCD_SIZE 22
+#define ZIP_CD_SIZE 46
+#define ZIP_LOCAL_SIZE 30
+#define ZIP_MAX_COMMENT 65535
+#define ZIP_STORED 0
+#define ZIP_DEFLATED 8
+
+#define TAR_BLOCK 512
+
+// Archive input: a file descriptor, read through zlib for gzip compressed files
+typedef struct Reader {
+    int fd;
+#ifdef HAVE_ZLIB
+    gzFile gz;
+#endif
+} Reader;
+
+// Cache entry, for the eviction
+typedef struct CacheEntry {
+    char* name;
+    struct timespec used;
+    off_t size;
+} CacheEntry;
+
+/* Little endian integers in `p` */
+static uint16_t le16(const unsigned char* p);
+static uint32_t le32(const unsigned char* p);
+
+/* Return 1 if `path` ends with `suffix`, case insensitive */
+static int has_suffix(const char* path, const char* suffix);
+
+/* Open `path` in `reader`, decompressing it if `gzip`. Return 0 on success */
+static int reader_open(Reader* reader, const char* path, int gzip);
+
+/* Read `len` bytes, return the number of bytes read or -1 */
+static ssize_t reader_read(Reader* reader, void* buf, size_t len);
+
+/* Skip `len` bytes. Return 0 on success */
+static int reader_skip(Reader* reader, off_t len);
+
+static void reader_close(Reader* reader);
+
+/* Return the CRC-32 `crc` updated with `len` bytes of `buf` */
+static uint32_t crc32_update(uint32_t crc, const unsigned char* buf, size_t len);
+
+/* Copy `len` bytes from `reader` to `out`, updating `*crc` with them if not NULL. Return 0
+ * on success */
+static int copy_data(Reader* reader, int out, off_t len, uint32_t* crc);
+
+/* Extract the member `member` of the zip `fd` to `out`. Return 0 on success */
+static int zip_extract(int fd, const char* member, int out);
+
+/* Inflate `len` raw deflate bytes from `fd` to `out`. Return 0 on success */
+static int zip_inflate(int fd, off_t len, int out, uint32_t* crc);
+
+/* Extract the member `member` of the (maybe compressed) tar `path` to `out`. Return 0 on
+ * success */
+static int tar_extract(const char* path, int gzip, const char* member, int out);
+
+/* Parse the octal number of `len` characters in `s` */
+static off_t tar_octal(const char* s, size_t len);
+
+/* Return the cache directory (to be freed) */
+static char* cache_dir();
+
+/* Remove the least recently used entries of the cache `dir` while its size exceeds the
+ * limit. The entry `keep` is never removed */
+static void cache_evict(const char* dir, const char* keep);
+
+/* Remove the entry directory `name` of the cache `dir` with its content */
+static void cache_remove(const char* dir, const char* name);
+
+static uint16_t le16(const unsigned char* p) {
+    return p[0] | p[1] << 8;
+}
+
+static uint32_t le32(const unsigned char* p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static int has_suffix(const char* path, const char* suffix) {
+    size_t ln = strlen(path);
+    size_t suffix_ln = strlen(suffix);
+    return ln > suffix_ln && strcasecmp(path + ln - suffix_ln, suffix) == 0;
+}
+
+int archive_supported(const char* path) {
+    return has_suffix(path, ".zip") || has_suffix(path, ".tar") ||
+           has_suffix(path, ".tar.gz") || has_suffix(path, ".tgz");
+}
+
+static int reader_open(Reader* reader, const char* path, int gzip) {
+    reader->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (reader->fd < 0) return 1;
+#ifdef HAVE_ZLIB
+    reader->gz = NULL;
+    if (gzip) {
+        reader->gz = gzdopen(reader->fd, "rb");
+        if (!reader->gz) {
+            close(reader->fd);
+            return 1;
+        }
+        gzbuffer(reader->gz, COPY_BUFFER);
+    }
+#else
+    if (gzip) {
+        fprintf(stderr, "Compressed tar archives are not supported (built without zlib)\n");
+        close(reader->fd);
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+static ssize_t reader_read(Reader* reader, void* buf, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n;
+#ifdef HAVE_ZLIB
+        if (reader->gz) {
+            n = gzread(reader->gz, (char*)buf + done, len - done);
+        } else
+#endif
+        n = read(reader->fd, (char*)buf + done, len - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return -1;
+        if (n == 0) break;
+        done += n;
+    }
+    return done;
+}
+
+static int reader_skip(Reader* reader, off_t len) {
+#ifdef HAVE_ZLIB
+    if (reader->gz) return gzseek(reader->gz, len, SEEK_CUR) < 0;
+#endif
+    return lseek(reader->fd, len, SEEK_CUR) < 0;
+}
+
+static void reader_close(Reader* reader) {
+#ifdef HAVE_ZLIB
+    if (reader->gz) {
+        // closes the file descriptor too
+        gzclose(reader->gz);
+        return;
+    }
+#endif
+    close(reader->fd);
+}
+
+static uint32_t crc32_update(uint32_t crc, const unsigned char* buf, size_t len) {
+#ifdef HAVE_ZLIB
+    return crc32(crc, buf, len);
+#else
+    // bitwise, without the tables of zlib
+    crc = ~crc;
+    for (size_t i = 0; i < len; ++i) {
+        crc ^= buf[i];
+        for (int k = 0; k < 8; ++k) crc = crc >> 1 ^ (0xedb88320 & -(crc & 1));
+    }
+    return ~crc;
+#endif
+}
+
+static int copy_data(Reader* reader, int out, off_t len, uint32_t* crc) {
+    unsigned char* buf = xmalloc(COPY_BUFFER);
+    int res = 0;
+    while (len > 0 && !res) {
+        size_t chunk = len < COPY_BUFFER ? len : COPY_BUFFER;
+        ssize_t n = reader_read(reader, buf, chunk);
+        res = n != (ssize_t)chunk || write(out, buf, n) != n;
+        if (crc && !res) *crc = crc32_update(*crc, buf, n);
+        len -= chunk;
+    }
+    free(buf);
+    return res;
+}
+
+static int zip_inflate(int fd, off_t len, int out, uint32_t* crc) {
+#ifdef HAVE_ZLIB
+    unsigned char* in = xmalloc(COPY_BUFFER);
+    unsigned char* buf = xmalloc(COPY_BUFFER);
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // raw deflate data, without zlib header
+    int res = inflateInit2(&stream, -MAX_WBITS) != Z_OK;
+    int status = Z_OK;
+    while (!res && status != Z_STREAM_END) {
+        if (stream.avail_in == 0) {
+            if (len == 0) {
+                res = 1;
+                break;
+            }
+            ssize_t n = read(fd, in, len < COPY_BUFFER ? len : COPY_BUFFER);
+            if (n <= 0) {
+                res = 1;
+                break;
+            }
+            len -= n;
+            stream.next_in = in;
+            stream.avail_in = n;
+        }
+        stream.next_out = buf;
+        stream.avail_out = COPY_BUFFER;
+        status = inflate(&stream, Z_NO_FLUSH);
+        if (status != Z_OK && status != Z_STREAM_END) res = 1;
+        size_t produced = COPY_BUFFER - stream.avail_out;
+        *crc = crc32_update(*crc, buf, produced);
+        if (!res && write(out, buf, produced) != (ssize_t)produced) res = 1;
+    }
+    inflateEnd(&stream);
+    free(in);
+    free(buf);
+    return res;
+#else
+    (void)fd;
+    (void)len;
+    (void)out;
+    (void)crc;
+    fprintf(stderr, "Deflated zip members are not supported (built without zlib)\n");
+    return 1;
+#endif
+}
+
+static int zip_extract(int fd, const char* member, int out) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < ZIP_EOCD_SIZE) return 1;
+    // the end of central directory record is followed by a comment of up to 64K
+    off_t tail_len = st.st_size < ZIP_EOCD_SIZE + ZIP_MAX_COMMENT ?
+                     st.st_size : ZIP_EOCD_SIZE + ZIP_MAX_COMMENT;
+    unsigned char* tail = xmalloc(tail_len);
+    if (pread(fd, tail, tail_len, st.st_size - tail_len) != tail_len) {
+        free(tail);
+        return 1;
+    }
+    const unsigned char* eocd = NULL;
+    for (off_t i = tail_len - ZIP_EOCD_SIZE; i >= 0 && !eocd; --i) {
+        if (le32(tail + i) == ZIP_EOCD_SIGNATURE) eocd = tail + i;
+    }
+    if (!eocd) {
+        free(tail);
+        fprintf(stderr, "Invalid zip archive\n");
+        return 1;
+    }
+    uint32_t cd_size = le32(eocd + 12);
+    uint32_t cd_offset = le32(eocd + 16);
+    free(tail);
+    if (cd_offset == 0xffffffff || (off_t)cd_offset + cd_size > st.st_size) {
+        fprintf(stderr, "Unsupported zip archive (zip64 or invalid)\n");
+        return 1;
+    }
+    unsigned char* cd = xmalloc(cd_size);
+    if (pread(fd, cd, cd_size, cd_offset) != (ssize_t)cd_size) {
+        free(cd);
+        return 1;
+    }
+
+    // search the member in the central directory
+    size_t member_ln = strlen(member);
+    const unsigned char* entry = NULL;
+    for (size_t pos = 0; pos + ZIP_CD_SIZE <= cd_size && !entry; ) {
+        const unsigned char* p = cd + pos;
+        if (le32(p) != ZIP_CD_SIGNATURE) break;
+        size_t name_ln = le16(p + 28);
+        if (pos + ZIP_CD_SIZE + name_ln > cd_size) break;
+        if (name_ln == member_ln && memcmp(p + ZIP_CD_SIZE, member, name_ln) == 0) entry = p;
+        pos += ZIP_CD_SIZE + name_ln + le16(p + 30) + le16(p + 32);
+    }
+    if (!entry) {
+        free(cd);
+        fprintf(stderr, "%s not found in the archive\n", member);
+        return 1;
+    }
+    uint16_t flags = le16(entry + 8);
+    uint16_t method = le16(entry + 10);
+    uint32_t crc = le32(entry + 16);
+    uint32_t compressed = le32(entry + 20);
+    uint32_t size = le32(entry + 24);
+    uint32_t local_offset = le32(entry + 42);
+    free(cd);
+    if (flags & 1 || (method != ZIP_STORED && method != ZIP_DEFLATED) ||
+        compressed == 0xffffffff || size == 0xffffffff || local_offset == 0xffffffff) {
+        fprintf(stderr, "Unsupported zip member %s (encrypted, zip64 or unknown method)\n",
+                member);
+        return 1;
+    }
+
+    // the data follows the local header, whose variable fields can differ from the
+    // central directory ones
+    unsigned char local[ZIP_LOCAL_SIZE];
+    if (pread(fd, local, ZIP_LOCAL_SIZE, local_offset) != ZIP_LOCAL_SIZE ||
+        le32(local) != ZIP_LOCAL_SIGNATURE) {
+        fprintf(stderr, "Invalid zip archive\n");
+        return 1;
+    }
+    off_t data = (off_t)local_offset + ZIP_LOCAL_SIZE + le16(local + 26) + le16(local + 28);
+    if (lseek(fd, data, SEEK_SET) != data) return 1;
+    uint32_t computed = 0;
+    if (method == ZIP_STORED) {
+        Reader reader = {fd};
+#ifdef HAVE_ZLIB
+        reader.gz = NULL;
+#endif
+        if (copy_data(&reader, out, size, &computed) != 0) return 1;
+    } else if (zip_inflate(fd, compressed, out, &computed) != 0) {
+        return 1;
+    }
+    if (computed != crc) {
+        fprintf(stderr, "CRC error extracting %s\n", member);
+        return 1;
+    }
+    return 0;
+}
+
+static off_t tar_octal(const char* s, size_t len) {
+    off_t res = 0;
+    for (size_t i = 0; i < len && s[i]; ++i) {
+        if (s[i] >= '0' && s[i] <= '7') res = res * 8 + s[i] - '0';
+    }
+    return res;
+}
+
+static int tar_extract(const char* path, int gzip, const char* member, int out) {
+    Reader reader;
+    if (reader_open(&reader, path, gzip) != 0) {
+        fprintf(stderr, "Couldn't open %s\n", path);
+        return 1;
+    }
+    // leading "./" of the member names are ignored
+    while (strncmp(member, "./", 2) == 0) member += 2;
+    char header[TAR_BLOCK];
+    // name of the next entry, from a GNU long name or a pax header (NULL if not set)
+    char* long_name = NULL;
+    int res = 1;
+    int found = 0;
+    while (reader_read(&reader, header, TAR_BLOCK) == TAR_BLOCK && header[0]) {
+        off_t size = tar_octal(header + 124, 12);
+        off_t padded = (size + TAR_BLOCK - 1) / TAR_BLOCK * TAR_BLOCK;
+        char type = header[156];
+        if (type == 'L' || type == 'x') {
+            // the entry data is the name (GNU) or a list of records (pax) of the next one
+            char* data = xmalloc(size + 1);
+            if (reader_read(&reader, data, size) != size ||
+                reader_skip(&reader, padded - size) != 0) {
+                free(data);
+                break;
+            }
+            data[size] = 0;
+            if (type == 'L') {
+                free(long_name);
+                long_name = data;
+                continue;
+            }
+            // pax records: "<length> <key>=<value>\n"
+            for (char* record = data; record < data + size; ) {
+                char* end;
+                long ln = strtol(record, &end, 10);
+                if (ln <= 0 || record + ln > data + size) break;
+                if (strncmp(end, " path=", 6) == 0) {
+                    free(long_name);
+                    long_name = strndup(end + 6, record + ln - 1 - (end + 6));
+                }
+                record += ln;
+            }
+            free(data);
+            continue;
+        }
+        // prefix (155), '/', name (100) and terminator
+        char name[TAR_BLOCK];
+        if (long_name) {
+            snprintf(name, sizeof(name), "%s", long_name);
+        } else if (strncmp(header + 257, "ustar", 5) == 0 && header[345]) {
+            // ustar: the name is split in prefix and name
+            snprintf(name, sizeof(name), "%.155s/%.100s", header + 345, header);
+        } else {
+            snprintf(name, sizeof(name), "%.100s", header);
+        }
+        free(long_name);
+        long_name = NULL;
+        char* entry_name = name;
+        while (strncmp(entry_name, "./", 2) == 0) entry_name += 2;
+        if ((type == '0' || type == 0) && strcmp(entry_name, member) == 0) {
+            found = 1;
+            res = copy_data(&reader, out, size, NULL);
+            break;
+        }
+        if (reader_skip(&reader, padded) != 0) break;
+    }
+    if (!found) fprintf(stderr, "%s not found in the archive\n", member);
+    free(long_name);
+    reader_close(&reader);
+    return res;
+}
+
+static char* cache_dir() {
+    char* dir = xdg_aperi_path("XDG_CACHE_HOME", ".cache", ARCHIVES_DIR "/");
+    mkdir(dir, 0700);
+    return dir;
+}
+
+static void cache_remove(const char* dir, const char* name) {
+    int dir_fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd < 0) return;
+    int entry_fd = openat(dir_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR* entry = entry_fd >= 0 ? fdopendir(entry_fd) : NULL;
+    if (entry) {
+        struct dirent* dp;
+        while ((dp = readdir(entry))) {
+            if (dp->d_name[0] != '.' || (dp->d_name[1] && strcmp(dp->d_name, "..") != 0)) {
+                unlinkat(entry_fd, dp->d_name, 0);
+            }
+        }
+        closedir(entry);
+    } else if (entry_fd >= 0) {
+        close(entry_fd);
+    }
+    unlinkat(dir_fd, name, AT_REMOVEDIR);
+    close(dir_fd);
+}
+
+static int cmp_used(const void* a, const void* b) {
+    const struct timespec* x = &((const CacheEntry*)a)->used;
+    const struct timespec* y = &((const CacheEntry*)b)->used;
+    if (x->tv_sec != y->tv_sec) return x->tv_sec < y->tv_sec ? -1 : 1;
+    return x->tv_nsec < y->tv_nsec ? -1 : x->tv_nsec > y->tv_nsec;
+}
+
+static void cache_evict(const char* dir, const char* keep) {
+    const char* limit_env = getenv("APERI_ARCHIVE_CACHE_SIZE");
+    unsigned long long limit;
+    if (!limit_env || parse_size(limit_env, &limit) != 0) {
+        parse_size(DEFAULT_CACHE_SIZE, &limit);
+    }
+    DIR* d = opendir(dir);
+    if (!d) return;
+    int dir_fd = dirfd(d);
+    CacheEntry* entries = NULL;
+    size_t n_entries = 0;
+    unsigned long long total = 0;
+    struct dirent* dp;
+    while ((dp = readdir(d))) {
+        if (dp->d_name[0] == '.') continue;
+        struct stat st;
+        if (fstatat(dir_fd, dp->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0 ||
+            !S_ISDIR(st.st_mode)) {
+            continue;
+        }
+        // the size of an entry is the size of its files (only the member, usually)
+        off_t size = 0;
+        int entry_fd = openat(dir_fd, dp->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        DIR* entry = entry_fd >= 0 ? fdopendir(entry_fd) : NULL;
+        if (entry) {
+            struct dirent* file;
+            struct stat file_st;
+            while ((file = readdir(entry))) {
+                if (fstatat(entry_fd, file->d_name, &file_st, AT_SYMLINK_NOFOLLOW) == 0 &&
+                    S_ISREG(file_st.st_mode)) {
+                    size += file_st.st_blocks * 512;
+                }
+            }
+            closedir(entry);
+        } else if (entry_fd >= 0) {
+            close(entry_fd);
+        }
+        entries = xrealloc(entries, (n_entries + 1) * sizeof(CacheEntry));
+        entries[n_entries].name = strdup(dp->d_name);
+        entries[n_entries].used = st.st_mtim;
+        entries[n_entries++].size = size;
+        total += size;
+    }
+    closedir(d);
+    qsort(entries, n_entries, sizeof(CacheEntry), cmp_used);
+    for (size_t i = 0; i < n_entries; ++i) {
+        if (total > limit && strcmp(entries[i].name, keep) != 0) {
+            cache_remove(dir, entries[i].name);
+            total -= entries[i].size;
+        }
+        free(entries[i].name);
+    }
+    free(entries);
+}
+
+char* archive_extract(const char* archive, const char* member) {
+    struct stat st;
+    if (stat(archive, &st) != 0) {
+        fprintf(stderr, "Couldn't stat %s\n", archive);
+        return NULL;
+    }
+    const char* name = strrchr(member, '/');
+    name = name ? name + 1 : member;
+    if (!*name || strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+        fprintf(stderr, "Invalid archive member %s\n", member);
+        return NULL;
+    }
+    // key of the cache entry: FNV-1a hash of the archive identity and of the member
+    char* identity;
+    if (asprintf(&identity, "%llu:%llu:%lld:%lld.%ld:%s", (unsigned long long)st.st_dev,
+                 (unsigned long long)st.st_ino, (long long)st.st_size,
+                 (long long)st.st_mtim.tv_sec, st.st_mtim.tv_nsec, member) < 0) {
+        return NULL;
+    }
+    uint64_t hash = 14695981039346656037ULL;
+    for (const char* c = identity; *c; ++c) {
+        hash ^= (unsigned char)*c;
+        hash *= 1099511628211ULL;
+    }
+    free(identity);
+    char key[17];
+    snprintf(key, sizeof(key), "%016llx", (unsigned long long)hash);
+
+    char* dir = cache_dir();
+    char* entry_dir;
+    char* path;
+    char* tmp_path;
+    if (asprintf(&entry_dir, "%s%s", dir, key) < 0 ||
+        asprintf(&path, "%s/%s", entry_dir, name) < 0 ||
+        asprintf(&tmp_path, "%s/.%s.XXXXXX", entry_dir, name) < 0) {
+        exit(1);
+    }
+    if (access(path, F_OK) == 0) {
+        // cache hit: mark the entry as used
+        utimensat(AT_FDCWD, entry_dir, NULL, 0);
+    } else {
+        int res = 1;
+        mkdir(entry_dir, 0700);
+        int out = mkstemp(tmp_path);
+        if (out >= 0) {
+            if (has_suffix(archive, ".zip")) {
+                int fd = open(archive, O_RDONLY | O_CLOEXEC);
+                res = fd < 0 || zip_extract(fd, member, out);
+                if (fd >= 0) close(fd);
+            } else {
+                int gzip = !has_suffix(archive, ".tar");
+                res = tar_extract(archive, gzip, member, out);
+            }
+            // the complete member is moved in place at once, for concurrent openers
+            if (close(out) != 0) res = 1;
+            if (!res) res = rename(tmp_path, path) != 0;
+            if (res) unlink(tmp_path);
+        }
+        if (res) {
+            fprintf(stderr, "Couldn't extract %s from %s\n", member, archive);
+            rmdir(entry_dir);
+            free(path);
+            path = NULL;
+        } else {
+            cache_evict(dir, key);
+        }
+    }
+    free(tmp_path);
+    free(entry_dir);
+    free(dir);
+    return path;
+}
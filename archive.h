@@ -0,0 +1,25 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+/* Extraction of single archive members, for the `<archive>#<member>` arguments.
+ *
+ * Supported archives are zip (stored and deflated members) and tar, optionally
+ * compressed with gzip (`.tar.gz`, `.tgz`). Deflated and gzip compressed data need zlib
+ * (HAVE_ZLIB). Only the requested member is extracted, streaming it from the archive.
+ *
+ * Members are extracted in `$XDG_CACHE_HOME/aperi/archives/<key>/<member name>`, where
+ * the key is a hash of the archive identity (device, inode, size and modification time)
+ * and of the member path, so that opening the same member again reuses the cached copy
+ * until the archive changes. Every use of an entry updates its modification time: when
+ * the total size of the cache exceeds `$APERI_ARCHIVE_CACHE_SIZE` bytes (1G by default,
+ * with an optional K/M/G/T suffix) the least recently used entries are removed. */
+
+/* Return 1 if `path` has the extension of a supported archive */
+int archive_supported(const char* path);
+
+/* Return the path of the cached copy of the member `member` of the archive `archive`,
+ * extracting it if needed. The result must be freed. Return NULL and print an error if
+ * the member can't be extracted. */
+char* archive_extract(const char* archive, const char* member);
+
+#endif
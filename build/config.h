@@ -0,0 +1,12 @@
+#ifndef VERSION_H
+#define VERSION_H
+
+#define VERSION "0.11.0-pre"
+
+/* #undef HAVE_USDT */
+
+/* #undef HAVE_DEFAULT_CONFIG */
+
+/* #undef HAVE_ZLIB */
+
+#endif
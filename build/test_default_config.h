@@ -0,0 +1,44 @@
+/* Generated by aperi_compile from tests/config/aperi/config: do not edit */
+static const char DEFAULT_CONFIG[] =
+    "a=echo 1\n"
+    "b,c=echo 2\n"
+    "d://=echo 3\n"
+    "e://,f://=echo 4\n"
+    "/.project-marker=echo 36\n"
+    "/*.jpg=echo 37\n"
+    "/*.txt=echo never\n"
+    "/=echo 5\n"
+    "f=%echo 6\n"
+    "g=%echo 7 %%f\n"
+    "h=%echo 8 %f foo\n"
+    "i=echo 9 %%\n"
+    "j=echo 10 %f\n"
+    "k=printf \"%q 12 13 \\n\"\n"
+    "l=echo \"13\"\"14\"\n"
+    "m=echo \"\"\"1516\"\n"
+    "n=echo \"1718\"\"\"\n"
+    "\",\"=echo 19\n"
+    "\"=\"=echo 20\n"
+    "\"\"=echo 21\n"
+    "http://youtu.be/=echo http://youtu.be/\n"
+    "glob:*/files/test.p=echo 23\n"
+    "regex:test\\.[qr]$=echo 24\n"
+    "q=echo never\n"
+    "glob:http://*.glob.test/=echo 25\n"
+    "glob:**/test.a=echo never\n"
+    "u=aperi-missing-executable 28\n"
+    "u=echo 28\n"
+    "v=[nice=7 nofile=64 invalid]%sh -c \"echo 29 $(nice) $(ulimit -n)\"\n"
+    "w=[prefetch=1M]echo 30\n"
+    "y=%sh -c \"echo 32 $(cat %f)\"\n"
+    "glob:stdin.pdf=%sh -c \"echo 33 $(head -c 5 %f)\"\n"
+    "z&fifo,z&size>0=echo 34\n"
+    "z&!size>0&file&!exec=echo 35\n"
+    "x=[cwd=%d]%sh -c \"echo 31 \"\"$1\"\" \"\"$2\"\" $(basename \"\"$PWD\"\") %q\" sh %n %q\n"
+    "srv=[server=\"../build/listen_socket @aperi-test$XDG_CACHE_HOME 10\" socket=@aperi-test$XDG_CACHE_HOME]%echo 38 %n\n"
+    "s=@aperi-test.desktop\n"
+    "t=@sub-entry.desktop\n"
+    "http=echo .http\n"
+    "http://,https://=echo http://\n"
+    "o=%echo 22 test%f-%ftest\n"
+    "/*=echo 999\n";
@@ -0,0 +1,11 @@
+#ifndef COMPILED_CONFIG_H
+#define COMPILED_CONFIG_H
+
+/* Compiled config files, written by aperi_compile and mapped by aperi in place of the
+ * text config: the COMPILED_CONFIG_MAGIC line followed by the rule lines of the config,
+ * without its comments and empty lines, that aperi parses like the text config. */
+
+// First line of the compiled config files
+#define COMPILED_CONFIG_MAGIC "aperi compiled config 1\n"
+
+#endif
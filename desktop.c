@@ -0,0 +1,453 @@
+#define _GNU_SOURCE 1
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "desktop.h"
+#include "util.h"
+
+#define INDEX_NAME "applications.index"
+#define INDEX_MAGIC "aperi-applications-index 1\n"
+
+// Desktop entry collected while building the index. Values are kept as found in the file.
+typedef struct IndexEntry {
+    char* id;
+    // position of the applications directory in the search path: the lowest wins
+    int order;
+    char* path;
+    char* exec;
+    char* name;
+    char* icon;
+} IndexEntry;
+
+typedef struct Index {
+    IndexEntry* entries;
+    int n;
+    int allocated;
+    // output file (NULL if the index can't be saved)
+    FILE* f;
+} Index;
+
+/* Return the NULL terminated list of applications directories, in order of precedence */
+static char** applications_dirs();
+
+/* Check that the index in `f` was built from `dirs` and that none of its directories
+ * changed since. On success `f` is left positioned at the first entry. */
+static int index_valid(FILE* f, char** dirs);
+
+/* Scan all the applications directories, writing the index to `index->f` if set */
+static void index_build(Index* index, char** dirs);
+
+/* Scan the directory `dir` (and its subdirectories) adding its entries to `index`. `prefix`
+ * is the desktop id prefix for the entries of the directory */
+static void index_scan_dir(Index* index, const char* dir, const char* prefix, int order);
+
+/* Parse the desktop file `path` and add it to `index` with id `id` */
+static void index_add_file(Index* index, const char* path, const char* id, int order);
+
+/* Expand the desktop entry string escapes of `s` (\s, \n, \t, \r and \\). The result
+ * must be freed. */
+static char* unescape(const char* s);
+
+/* Fill `entry` from the raw values of an index entry */
+static void entry_fill(DesktopEntry* entry, const char* path, const char* exec,
+                       const char* name, const char* icon);
+
+static char** applications_dirs() {
+    const char* xdg_data_home = getenv("XDG_DATA_HOME");
+    char* data_home;
+    if (xdg_data_home && *xdg_data_home) {
+        data_home = xmalloc(strlen(xdg_data_home) + 2);
+        stpcpy(stpcpy(data_home, xdg_data_home), "/");
+    } else {
+        data_home = xmalloc(strlen(get_homedir()) + 15);
+        stpcpy(stpcpy(data_home, get_homedir()), "/.local/share/");
+    }
+    const char* data_dirs = getenv("XDG_DATA_DIRS");
+    if (!data_dirs || !*data_dirs) data_dirs = "/usr/local/share:/usr/share";
+
+    int n = 2;
+    for (const char* c = data_dirs; *c; ++c) n += *c == ':';
+    char** dirs = xmalloc((n + 1) * sizeof(char*));
+    n = 0;
+    dirs[n] = xmalloc(strlen(data_home) + 14);
+    stpcpy(stpcpy(dirs[n++], data_home), "applications");
+    free(data_home);
+    const char* start = data_dirs;
+    while (*start) {
+        const char* end = strchrnul(start, ':');
+        if (end > start) {
+            dirs[n] = xmalloc(end - start + 15);
+            char* p = mempcpy(dirs[n], start, end - start);
+            if (p[-1] != '/') *p++ = '/';
+            strcpy(p, "applications");
+            ++n;
+        }
+        start = *end ? end + 1 : end;
+    }
+    dirs[n] = NULL;
+    return dirs;
+}
+
+static int index_valid(FILE* f, char** dirs) {
+    char* line = NULL;
+    size_t allocated = 0;
+    ssize_t ln;
+    int valid = getline(&line, &allocated, f) > 0 && strcmp(line, INDEX_MAGIC) == 0;
+    // the search path must be the same...
+    for (char** dir = dirs; valid && *dir; ++dir) {
+        valid = (ln = getline(&line, &allocated, f)) > 2 && line[0] == 'T' &&
+                line[ln-1] == '\n' && strncmp(line + 2, *dir, ln - 3) == 0 &&
+                (*dir)[ln-3] == 0;
+    }
+    // ...and no directory must have been modified
+    long pos = ftell(f);
+    while (valid && (ln = getline(&line, &allocated, f)) > 0 && line[0] != 'E') {
+        if (line[0] != 'D') {
+            valid = 0;
+            break;
+        }
+        if (line[ln-1] == '\n') line[ln-1] = 0;
+        long long sec;
+        long nsec;
+        int path_start;
+        if (sscanf(line, "D %lld %ld %n", &sec, &nsec, &path_start) != 2) {
+            valid = 0;
+            break;
+        }
+        struct stat statbuf;
+        if (stat(line + path_start, &statbuf) == 0) {
+            valid = statbuf.st_mtim.tv_sec == sec && statbuf.st_mtim.tv_nsec == nsec;
+        } else {
+            valid = sec == -1;
+        }
+        pos = ftell(f);
+    }
+    free(line);
+    if (valid) fseek(f, pos, SEEK_SET);
+    return valid;
+}
+
+static int entry_cmp(const void* a, const void* b) {
+    const IndexEntry* ea = a;
+    const IndexEntry* eb = b;
+    int res = strcmp(ea->id, eb->id);
+    return res ? res : ea->order - eb->order;
+}
+
+/* Write `s` to `f` replacing tabs with the equivalent `\t` escape */
+static void write_value(FILE* f, const char* s) {
+    for (; *s; ++s) {
+        if (*s == '\t') {
+            fputs("\\t", f);
+        } else {
+            fputc(*s, f);
+        }
+    }
+}
+
+static void index_build(Index* index, char** dirs) {
+    if (index->f) {
+        fputs(INDEX_MAGIC, index->f);
+        for (char** dir = dirs; *dir; ++dir) fprintf(index->f, "T %s\n", *dir);
+    }
+    for (int i = 0; dirs[i]; ++i) index_scan_dir(index, dirs[i], "", i);
+    // keep only the entry of the directory with the highest precedence for each id
+    qsort(index->entries, index->n, sizeof(IndexEntry), entry_cmp);
+    int n = 0;
+    for (int i = 0; i < index->n; ++i) {
+        IndexEntry* e = &index->entries[i];
+        if (n > 0 && strcmp(index->entries[n-1].id, e->id) == 0) {
+            free(e->id);
+            free(e->path);
+            free(e->exec);
+            free(e->name);
+            free(e->icon);
+            continue;
+        }
+        index->entries[n++] = *e;
+    }
+    index->n = n;
+    if (!index->f) return;
+    for (int i = 0; i < index->n; ++i) {
+        IndexEntry* e = &index->entries[i];
+        fprintf(index->f, "E %s\t", e->id);
+        write_value(index->f, e->path);
+        fputc('\t', index->f);
+        write_value(index->f, e->exec);
+        fputc('\t', index->f);
+        write_value(index->f, e->name);
+        fputc('\t', index->f);
+        write_value(index->f, e->icon);
+        fputc('\n', index->f);
+    }
+}
+
+static void index_scan_dir(Index* index, const char* dir, const char* prefix, int order) {
+    struct stat statbuf;
+    DIR* d = opendir(dir);
+    if (!d || fstat(dirfd(d), &statbuf) != 0) {
+        if (index->f) fprintf(index->f, "D -1 0 %s\n", dir);
+        if (d) closedir(d);
+        return;
+    }
+    if (index->f) {
+        fprintf(index->f, "D %lld %ld %s\n", (long long)statbuf.st_mtim.tv_sec,
+                statbuf.st_mtim.tv_nsec, dir);
+    }
+    struct dirent* dp;
+    while ((dp = readdir(d)) != NULL) {
+        if (dp->d_name[0] == '.') continue;
+        char* path;
+        char* id;
+        if (asprintf(&path, "%s/%s", dir, dp->d_name) < 0) continue;
+        if (asprintf(&id, "%s%s", prefix, dp->d_name) < 0) {
+            free(path);
+            continue;
+        }
+        size_t ln = strlen(dp->d_name);
+        int is_dir = dp->d_type == DT_DIR ||
+                     (dp->d_type == DT_UNKNOWN && isdir(path));
+        if (is_dir) {
+            // entries in subdirectories have ids like <subdir>-<name>.desktop
+            char* sub_prefix;
+            if (asprintf(&sub_prefix, "%s-", id) >= 0) {
+                index_scan_dir(index, path, sub_prefix, order);
+                free(sub_prefix);
+            }
+        } else if (ln > 8 && strcmp(dp->d_name + ln - 8, ".desktop") == 0) {
+            index_add_file(index, path, id, order);
+        }
+        free(id);
+        free(path);
+    }
+    closedir(d);
+}
+
+static void index_add_file(Index* index, const char* path, const char* id, int order) {
+    FILE* f = fopen(path, "r");
+    if (!f) return;
+    char* line = NULL;
+    size_t allocated = 0;
+    ssize_t ln;
+    int in_entry = 0;
+    int hidden = 0;
+    char* values[3] = {NULL, NULL, NULL};
+    const char* keys[3] = {"Exec", "Name", "Icon"};
+    while ((ln = getline(&line, &allocated, f)) > 0) {
+        if (line[ln-1] == '\n') line[--ln] = 0;
+        if (line[0] == '[') {
+            // only the first group, [Desktop Entry], matters
+            if (in_entry) break;
+            in_entry = strcmp(line, "[Desktop Entry]") == 0;
+            continue;
+        }
+        char* eq = strchr(line, '=');
+        if (!in_entry || !eq) continue;
+        char* key_end = eq;
+        while (key_end > line && key_end[-1] == ' ') --key_end;
+        char* value = eq + 1;
+        while (*value == ' ') ++value;
+        size_t key_ln = key_end - line;
+        if (key_ln == 6 && strncmp(line, "Hidden", 6) == 0) {
+            hidden = strcmp(value, "true") == 0;
+        }
+        for (int i = 0; i < 3; ++i) {
+            if (!values[i] && key_ln == strlen(keys[i]) && strncmp(line, keys[i], key_ln) == 0) {
+                values[i] = strdup(value);
+            }
+        }
+    }
+    free(line);
+    fclose(f);
+
+    // hidden entries are deleted ones: keep them (with no Exec) to mask the other dirs
+    if (hidden) {
+        free(values[0]);
+        values[0] = NULL;
+    }
+    if (index->n == index->allocated) {
+        index->allocated = index->allocated ? index->allocated * 2 : 256;
+        index->entries = xrealloc(index->entries, index->allocated * sizeof(IndexEntry));
+    }
+    IndexEntry* e = &index->entries[index->n++];
+    e->id = strdup(id);
+    e->order = order;
+    e->path = strdup(path);
+    e->exec = values[0] ? values[0] : strdup("");
+    e->name = values[1] ? values[1] : strdup("");
+    e->icon = values[2] ? values[2] : strdup("");
+}
+
+static char* unescape(const char* s) {
+    char* res = xmalloc(strlen(s) + 1);
+    char* d = res;
+    for (; *s; ++s) {
+        if (*s == '\\' && s[1]) {
+            ++s;
+            switch (*s) {
+                case 's': *d++ = ' '; break;
+                case 'n': *d++ = '\n'; break;
+                case 't': *d++ = '\t'; break;
+                case 'r': *d++ = '\r'; break;
+                case '\\': *d++ = '\\'; break;
+                default: *d++ = '\\'; *d++ = *s; break;
+            }
+        } else {
+            *d++ = *s;
+        }
+    }
+    *d = 0;
+    return res;
+}
+
+static void entry_fill(DesktopEntry* entry, const char* path, const char* exec,
+                       const char* name, const char* icon) {
+    entry->path = unescape(path);
+    entry->exec = unescape(exec);
+    entry->name = unescape(name);
+    entry->icon = unescape(icon);
+}
+
+int desktop_entry_lookup(const char* id, DesktopEntry* entry) {
+    char** dirs = applications_dirs();
+    char* index_path = xdg_aperi_path("XDG_CACHE_HOME", ".cache", INDEX_NAME);
+    int found = 0;
+    FILE* f = fopen(index_path, "r");
+    if (f && index_valid(f, dirs)) {
+        // up to date index: search the entry
+        char* line = NULL;
+        size_t allocated = 0;
+        ssize_t ln;
+        size_t id_ln = strlen(id);
+        while ((ln = getline(&line, &allocated, f)) > 0) {
+            if (line[ln-1] == '\n') line[--ln] = 0;
+            if (line[0] != 'E' || strncmp(line + 2, id, id_ln) != 0 || line[id_ln + 2] != '\t') continue;
+            char* fields[4];
+            char* p = line + id_ln + 3;
+            for (int i = 0; i < 4; ++i) {
+                fields[i] = p;
+                p = strchrnul(p, '\t');
+                if (*p) *p++ = 0;
+            }
+            if (*fields[1]) {
+                entry_fill(entry, fields[0], fields[1], fields[2], fields[3]);
+                found = 1;
+            }
+            break;
+        }
+        free(line);
+    } else {
+        // missing or stale index: rebuild it
+        Index index = {NULL, 0, 0, NULL};
+        char* tmppath = NULL;
+        index.f = atomic_open(index_path, &tmppath);
+        index_build(&index, dirs);
+        if (index.f) atomic_commit(index.f, tmppath, index_path);
+        for (int i = 0; i < index.n; ++i) {
+            IndexEntry* e = &index.entries[i];
+            if (!found && *e->exec && strcmp(e->id, id) == 0) {
+                entry_fill(entry, e->path, e->exec, e->name, e->icon);
+                found = 1;
+            }
+            free(e->id);
+            free(e->path);
+            free(e->exec);
+            free(e->name);
+            free(e->icon);
+        }
+        free(index.entries);
+    }
+    if (f) fclose(f);
+    free(index_path);
+    for (char** dir = dirs; *dir; ++dir) free(*dir);
+    free(dirs);
+    return found ? 0 : 1;
+}
+
+void desktop_entry_free(DesktopEntry* entry) {
+    free(entry->path);
+    free(entry->exec);
+    free(entry->name);
+    free(entry->icon);
+}
+
+/* Append `arg` to the NULL terminated vector `*argv` of `*n` elements */
+static void argv_push(char*** argv, int* n, char* arg) {
+    *argv = xrealloc(*argv, (*n + 2) * sizeof(char*));
+    (*argv)[(*n)++] = arg;
+    (*argv)[*n] = NULL;
+}
+
+char** desktop_entry_argv(const DesktopEntry* entry, const char* arg) {
+    char** argv = NULL;
+    int n = 0;
+    int file_code = 0;
+    const char* p = entry->exec;
+    // room for the longest expansion of a single character
+    size_t expansion = strlen(arg) + strlen(entry->name) + strlen(entry->path) + 1;
+    while (*p) {
+        while (*p == ' ') ++p;
+        if (!*p) break;
+        // split the arguments following the Exec quoting rules
+        char* raw = xmalloc(strlen(p) + 1);
+        char* d = raw;
+        if (*p == '"') {
+            for (++p; *p && *p != '"'; ++p) {
+                if (*p == '\\' && p[1]) ++p;
+                *d++ = *p;
+            }
+            if (*p) ++p;
+        } else {
+            for (; *p && *p != ' '; ++p) *d++ = *p;
+        }
+        *d = 0;
+
+        // expand the field codes
+        if (strcmp(raw, "%i") == 0) {
+            if (*entry->icon) {
+                argv_push(&argv, &n, strdup("--icon"));
+                argv_push(&argv, &n, strdup(entry->icon));
+            }
+            free(raw);
+            continue;
+        }
+        char* res = xmalloc(strlen(raw) * expansion + 1);
+        d = res;
+        for (const char* c = raw; *c; ++c) {
+            if (*c != '%' || !c[1]) {
+                *d++ = *c;
+                continue;
+            }
+            switch (*++c) {
+                case 'f': case 'F': case 'u': case 'U':
+                    d = stpcpy(d, arg);
+                    file_code = 1;
+                    break;
+                case 'c':
+                    d = stpcpy(d, entry->name);
+                    break;
+                case 'k':
+                    d = stpcpy(d, entry->path);
+                    break;
+                case '%':
+                    *d++ = '%';
+                    break;
+                // deprecated and unknown field codes are removed
+            }
+        }
+        *d = 0;
+        free(raw);
+        argv_push(&argv, &n, res);
+    }
+    if (!file_code) argv_push(&argv, &n, strdup(arg));
+    return argv;
+}
+
+void desktop_argv_free(char** argv) {
+    if (!argv) return;
+    for (char** arg = argv; *arg; ++arg) free(*arg);
+    free(argv);
+}
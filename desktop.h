@@ -0,0 +1,35 @@
+#ifndef DESKTOP_H
+#define DESKTOP_H
+
+/* Desktop entries (.desktop files) of the XDG applications directories.
+ *
+ * Entries are looked up in an index of all the applications directories, stored in
+ * `$XDG_CACHE_HOME/aperi/applications.index`. The index records the modification time of
+ * every directory it was built from and it's rebuilt only when one of them changes, so a
+ * lookup normally costs a stat per directory and the read of a single file. */
+
+typedef struct DesktopEntry {
+    // path of the .desktop file
+    char* path;
+    // Exec, Name and Icon keys of the [Desktop Entry] group (escapes already expanded)
+    char* exec;
+    char* name;
+    char* icon;
+} DesktopEntry;
+
+/* Look up the desktop entry with id `id` (for example `org.mozilla.firefox.desktop`).
+ * Return 0 and fill `entry` on success. */
+int desktop_entry_lookup(const char* id, DesktopEntry* entry);
+
+/* Free the strings of `entry` */
+void desktop_entry_free(DesktopEntry* entry);
+
+/* Return the NULL terminated arguments of the Exec key of `entry`, with the field codes
+ * expanded for the file or URI `arg`. If Exec has no file/URI field code `arg` is appended
+ * to the arguments. The result must be freed with desktop_argv_free(). */
+char** desktop_entry_argv(const DesktopEntry* entry, const char* arg);
+
+/* Free an argument vector returned by desktop_entry_argv() */
+void desktop_argv_free(char** argv);
+
+#endif
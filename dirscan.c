@@ -0,0 +1,97 @@
+#define _GNU_SOURCE 1
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "dirscan.h"
+#include "util.h"
+
+// Entry returned by getdents64(), not exported by the C library
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+/* qsort comparison of extensions, case insensitive */
+static int cmp_extensions(const void* a, const void* b);
+
+static int cmp_extensions(const void* a, const void* b) {
+    return strcasecmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+int dir_scan(const char* path, DirScan* scan) {
+    memset(scan, 0, sizeof(DirScan));
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return 1;
+    char* buf = xmalloc(DIR_SCAN_BUFFER);
+    long len = syscall(SYS_getdents64, fd, buf, DIR_SCAN_BUFFER);
+    close(fd);
+    if (len < 0) {
+        free(buf);
+        return 1;
+    }
+
+    // the names are at most as long as the entries that contain them
+    scan->names = xmalloc(len + 1);
+    const char** extensions = xmalloc(DIR_SCAN_MAX_ENTRIES * sizeof(char*));
+    int n_extensions = 0;
+    int n_files = 0;
+    int n_entries = 0;
+    for (long pos = 0; pos < len && n_entries < DIR_SCAN_MAX_ENTRIES; ++n_entries) {
+        struct linux_dirent64* entry = (struct linux_dirent64*)(buf + pos);
+        pos += entry->d_reclen;
+        const char* name = entry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+        char* stored = stpcpy(scan->names + scan->names_len, name) + 1;
+        if (entry->d_type == DT_REG || entry->d_type == DT_UNKNOWN) {
+            ++n_files;
+            // the extension follows the last dot, unless it starts the name
+            const char* dot = strrchr(name, '.');
+            if (dot && dot != name && dot[1]) {
+                extensions[n_extensions++] = scan->names + scan->names_len + (dot - name) + 1;
+            }
+        }
+        scan->names_len = stored - scan->names;
+    }
+    free(buf);
+
+    // find the most frequent extension among the sorted ones
+    qsort(extensions, n_extensions, sizeof(char*), cmp_extensions);
+    const char* dominant = NULL;
+    int dominant_count = 0;
+    for (int i = 0, count = 1; i < n_extensions; ++i, ++count) {
+        if (i + 1 < n_extensions && cmp_extensions(&extensions[i], &extensions[i + 1]) == 0) {
+            continue;
+        }
+        if (count > dominant_count) {
+            dominant = extensions[i];
+            dominant_count = count;
+        }
+        count = 0;
+    }
+    if (dominant && dominant_count * 2 >= n_files) {
+        scan->dominant_extension = strdup(dominant);
+    }
+    free(extensions);
+    return 0;
+}
+
+int dir_scan_has(const DirScan* scan, const char* name) {
+    for (size_t pos = 0; pos < scan->names_len; pos += strlen(scan->names + pos) + 1) {
+        if (strcmp(scan->names + pos, name) == 0) return 1;
+    }
+    return 0;
+}
+
+void dir_scan_free(DirScan* scan) {
+    free(scan->names);
+    free(scan->dominant_extension);
+    memset(scan, 0, sizeof(DirScan));
+}
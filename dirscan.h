@@ -0,0 +1,35 @@
+#ifndef DIRSCAN_H
+#define DIRSCAN_H
+
+#include <stddef.h>
+
+/* Bounded scan of the content of a directory, for the directory rules (`/<name>` and
+ * `/` followed by `*.<extension>`).
+ *
+ * The entries are read with a single getdents64() call in a buffer of DIR_SCAN_BUFFER
+ * bytes, and at most DIR_SCAN_MAX_ENTRIES of them are examined: opening a huge directory
+ * never turns into a full listing, at the cost of ignoring the entries past the first
+ * ones returned by the filesystem. */
+
+#define DIR_SCAN_BUFFER 32768
+#define DIR_SCAN_MAX_ENTRIES 1024
+
+typedef struct DirScan {
+    // names of the entries examined, NUL separated
+    char* names;
+    size_t names_len;
+    // most frequent extension of the regular files examined, if at least half of them
+    // have it (NULL otherwise)
+    char* dominant_extension;
+} DirScan;
+
+/* Scan the directory `path` and set `scan`. Return 0 on success, else `scan` is empty */
+int dir_scan(const char* path, DirScan* scan);
+
+/* Return 1 if the directory scanned in `scan` contains the entry `name` */
+int dir_scan_has(const DirScan* scan, const char* name);
+
+/* Free the memory allocated for `scan` */
+void dir_scan_free(DirScan* scan);
+
+#endif
@@ -0,0 +1,181 @@
+#define _GNU_SOURCE 1
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "localconfig.h"
+#include "util.h"
+
+#define LOCAL_CONFIG_NAME ".aperi"
+#define LOCAL_ROOTS_NAME "local-roots"
+#define NEGATIVE_CACHE_NAME "local-negative"
+// slots of the negative cache, a direct mapped table (the file is sparse)
+#define NEGATIVE_CACHE_SLOTS 4096
+
+// Negative cache record: a directory without `.aperi` as of its modification time
+typedef struct NegativeRecord {
+    uint64_t dev;
+    uint64_t ino;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    // hash of the other fields, detecting empty slots and records torn by concurrent
+    // writers
+    uint64_t check;
+} NegativeRecord;
+
+/* Return the root of `<config_dir>local-roots` containing `dir` (to be freed), or NULL */
+static char* find_root(const char* dir, const char* config_dir);
+
+/* Fill the check field of `record` and return it */
+static uint64_t record_check(NegativeRecord* record);
+
+/* Open the negative cache file. Return -1 if it's not available */
+static int negative_cache_open();
+
+/* Return 1 if the directory `st` is recorded in the negative cache `cache` */
+static int negative_cache_has(int cache, const struct stat* st);
+
+/* Record the directory `st` in the negative cache `cache`. Return 0 on success */
+static int negative_cache_add(int cache, const struct stat* st);
+
+/* Open `.aperi` in the directory `dir_fd` (named `dir`). Return its descriptor if it
+ * exists and it's trusted, -1 if it doesn't exist and -2 if it's untrusted */
+static int open_trusted(int dir_fd, const char* dir);
+
+static char* find_root(const char* dir, const char* config_dir) {
+    char* roots_path;
+    if (asprintf(&roots_path, "%s%s", config_dir, LOCAL_ROOTS_NAME) < 0) return NULL;
+    FILE* f = fopen(roots_path, "r");
+    free(roots_path);
+    if (!f) return NULL;
+    char* res = NULL;
+    char* line = NULL;
+    size_t allocated = 0;
+    ssize_t ln;
+    while (!res && (ln = getline(&line, &allocated, f)) >= 0) {
+        while (ln > 0 && (line[ln - 1] == '\n' || line[ln - 1] == '\r')) line[--ln] = 0;
+        if (ln == 0 || line[0] == '#') continue;
+        char* path = line;
+        char* joined = NULL;
+        if (line[0] != '/' && asprintf(&joined, "%s%s", config_dir, line) >= 0) {
+            path = joined;
+        }
+        char* root = realpath(path, NULL);
+        free(joined);
+        if (!root) continue;
+        size_t root_ln = strlen(root);
+        if (strncmp(dir, root, root_ln) == 0 &&
+            (dir[root_ln] == 0 || dir[root_ln] == '/' || root_ln == 1)) {
+            res = root;
+        } else {
+            free(root);
+        }
+    }
+    free(line);
+    fclose(f);
+    return res;
+}
+
+static uint64_t record_check(NegativeRecord* record) {
+    uint64_t fields[4] = {record->dev, record->ino, record->mtime_sec, record->mtime_nsec};
+    uint64_t hash = 14695981039346656037ULL;
+    const unsigned char* p = (const unsigned char*)fields;
+    for (size_t i = 0; i < sizeof(fields); ++i) {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    // never 0, the check of the empty slots
+    record->check = hash | 1;
+    return record->check;
+}
+
+static int negative_cache_open() {
+    // only in the runtime directory: the records die with the session
+    const char* runtime_dir = getenv("XDG_RUNTIME_DIR");
+    if (!runtime_dir || !*runtime_dir) return -1;
+    char* path = xdg_aperi_path("XDG_RUNTIME_DIR", ".cache", NEGATIVE_CACHE_NAME);
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC | O_NOFOLLOW, 0600);
+    free(path);
+    return fd;
+}
+
+static int negative_cache_has(int cache, const struct stat* st) {
+    if (cache < 0) return 0;
+    NegativeRecord record = {st->st_dev, st->st_ino, st->st_mtim.tv_sec, st->st_mtim.tv_nsec,
+                             0};
+    off_t slot = (record.dev * 31 + record.ino) % NEGATIVE_CACHE_SLOTS;
+    NegativeRecord stored;
+    if (pread(cache, &stored, sizeof(stored), slot * sizeof(stored)) != sizeof(stored)) {
+        return 0;
+    }
+    return stored.check == record_check(&record) && stored.dev == record.dev &&
+           stored.ino == record.ino && stored.mtime_sec == record.mtime_sec &&
+           stored.mtime_nsec == record.mtime_nsec;
+}
+
+static int negative_cache_add(int cache, const struct stat* st) {
+    if (cache < 0) return 1;
+    NegativeRecord record = {st->st_dev, st->st_ino, st->st_mtim.tv_sec, st->st_mtim.tv_nsec,
+                             0};
+    record_check(&record);
+    off_t slot = (record.dev * 31 + record.ino) % NEGATIVE_CACHE_SLOTS;
+    // colliding directories replace each other
+    return pwrite(cache, &record, sizeof(record), slot * sizeof(record)) != sizeof(record);
+}
+
+static int open_trusted(int dir_fd, const char* dir) {
+    int fd = openat(dir_fd, LOCAL_CONFIG_NAME, O_RDONLY | O_CLOEXEC | O_NOFOLLOW | O_NONBLOCK);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_uid != geteuid() ||
+        st.st_mode & (S_IWGRP | S_IWOTH)) {
+        fprintf(stderr, "Ignoring %s/%s: not a regular file owned by the user and writable "
+                "only by the user\n", dir, LOCAL_CONFIG_NAME);
+        close(fd);
+        return -2;
+    }
+    return fd;
+}
+
+int local_config_open(const char* dir, const char* config_dir) {
+    char* root = find_root(dir, config_dir);
+    if (!root) return -1;
+    // levels to walk up from `dir` to `root`, counting the separators after the root (the
+    // separator of `/` is the root itself)
+    size_t root_ln = strlen(root);
+    int levels = 0;
+    for (const char* c = dir + (root_ln == 1 ? 0 : root_ln); *c; ++c) {
+        if (*c == '/' && c[1] && c[1] != '/') ++levels;
+    }
+    free(root);
+    // path of the current directory, for the messages
+    char* path = strdup(dir);
+    int dir_fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    int cache = dir_fd >= 0 ? negative_cache_open() : -1;
+    int res = -1;
+    for (int level = 0; dir_fd >= 0 && level <= levels; ++level) {
+        struct stat st;
+        int stat_ok = fstat(dir_fd, &st) == 0;
+        if (!stat_ok || !negative_cache_has(cache, &st)) {
+            res = open_trusted(dir_fd, path);
+            if (res >= 0) break;
+            // untrusted files aren't recorded, to report them every time
+            if (res == -1 && stat_ok) negative_cache_add(cache, &st);
+            res = -1;
+        }
+        if (level == levels) break;
+        int parent = openat(dir_fd, "..", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        close(dir_fd);
+        dir_fd = parent;
+        char* slash = strrchr(path, '/');
+        if (slash) *(slash == path ? slash + 1 : slash) = 0;
+    }
+    if (dir_fd >= 0) close(dir_fd);
+    if (cache >= 0) close(cache);
+    free(path);
+    return res;
+}
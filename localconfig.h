@@ -0,0 +1,26 @@
+#ifndef LOCALCONFIG_H
+#define LOCALCONFIG_H
+
+/* Per-directory override configs: `.aperi` files with the syntax of the config file,
+ * applying to the arguments in their directory and its subdirectories.
+ *
+ * Since a `.aperi` file runs commands, only the directories under the roots listed in
+ * the `local-roots` file of the config directory (one path per line, relative paths
+ * starting from the config directory) are searched, and only `.aperi` files owned by the
+ * user and not writable by group and others are used. Without `local-roots` nothing is
+ * searched.
+ *
+ * The search walks up from the directory of the argument to its root with openat() on the
+ * directory descriptor held at each level, so that every step is a single path component
+ * lookup. The directories known to have no `.aperi` file are recorded, with their
+ * modification time, in `$XDG_RUNTIME_DIR/aperi/local-negative`: creating a `.aperi`
+ * file changes the time of its directory, so a record stays valid until then and the
+ * next searches replace the lookup of `.aperi` with an fstat() of the held descriptor,
+ * usually answered by the attribute cache also on network filesystems. */
+
+/* Return a descriptor of the nearest trusted `.aperi` file from the directory `dir`
+ * (absolute, with symlinks resolved) up to its root listed in `<config_dir>local-roots`,
+ * or -1 if there's none. Untrusted `.aperi` files are reported and skipped. */
+int local_config_open(const char* dir, const char* config_dir);
+
+#endif
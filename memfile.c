@@ -0,0 +1,110 @@
+#define _GNU_SOURCE 1
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "memfile.h"
+#include "util.h"
+
+// Maximum number of bytes moved by a single splice
+#define SPLICE_CHUNK (1 << 20)
+
+// A file signature: `magic` (`len` bytes) at `offset`
+typedef struct Signature {
+    size_t offset;
+    const char* magic;
+    size_t len;
+    const char* extension;
+} Signature;
+
+#define SIG(offset, magic, extension) {offset, magic, sizeof(magic) - 1, extension}
+
+static const Signature SIGNATURES[] = {
+    SIG(0, "%PDF-", "pdf"),
+    SIG(0, "%!PS", "ps"),
+    SIG(0, "\x89PNG\r\n\x1a\n", "png"),
+    SIG(0, "\xff\xd8\xff", "jpg"),
+    SIG(0, "GIF87a", "gif"),
+    SIG(0, "GIF89a", "gif"),
+    SIG(8, "WEBP", "webp"),
+    SIG(0, "PK\x03\x04", "zip"),
+    SIG(0, "\x1f\x8b", "gz"),
+    SIG(0, "BZh", "bz2"),
+    SIG(0, "\xfd" "7zXZ", "xz"),
+    SIG(0, "\x28\xb5\x2f\xfd", "zst"),
+    SIG(0, "7z\xbc\xaf\x27\x1c", "7z"),
+    SIG(0, "OggS", "ogg"),
+    SIG(0, "fLaC", "flac"),
+    SIG(0, "ID3", "mp3"),
+    SIG(0, "\x1a\x45\xdf\xa3", "mkv"),
+    SIG(4, "ftyp", "mp4"),
+    SIG(0, "{\\rtf", "rtf"),
+    SIG(0, "<?xml", "xml"),
+};
+
+/* Copy the rest of `fd` to `memfd` with read/write, for inputs that can't be spliced.
+ * Return 0 on success. */
+static int copy_fd(int fd, int memfd);
+
+static int copy_fd(int fd, int memfd) {
+    char buf[65536];
+    while (1) {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return n;
+        for (char* p = buf; n > 0;) {
+            ssize_t written = write(memfd, p, n);
+            if (written < 0 && errno == EINTR) continue;
+            if (written < 0) return -1;
+            p += written;
+            n -= written;
+        }
+    }
+}
+
+int memfile_from_fd(int fd, const char* name) {
+    int memfd = memfd_create(name, MFD_ALLOW_SEALING);
+    if (memfd < 0) {
+        perror("Couldn't create the memory file");
+        return -1;
+    }
+    int res;
+    while ((res = splice(fd, NULL, memfd, NULL, SPLICE_CHUNK, SPLICE_F_MOVE)) != 0) {
+        if (res < 0 && errno == EINTR) continue;
+        if (res < 0 && errno == EINVAL) {
+            // not a pipe (a regular file or a terminal): fall back to a plain copy
+            res = copy_fd(fd, memfd);
+            break;
+        }
+        if (res < 0) break;
+    }
+    if (res < 0 || fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE |
+                                             F_SEAL_SEAL) != 0) {
+        perror("Couldn't read the standard input");
+        close(memfd);
+        return -1;
+    }
+    lseek(memfd, 0, SEEK_SET);
+    return memfd;
+}
+
+const char* sniff_extension(const unsigned char* data, size_t len) {
+    for (size_t i = 0; i < sizeof(SIGNATURES) / sizeof(Signature); ++i) {
+        const Signature* sig = &SIGNATURES[i];
+        if (len >= sig->offset + sig->len &&
+            memcmp(data + sig->offset, sig->magic, sig->len) == 0) {
+            return sig->extension;
+        }
+    }
+    // text: HTML is recognized by its first tag, anything without NUL bytes is plain text
+    size_t start = 0;
+    while (start < len && data[start] && strchr(" \t\r\n", data[start])) ++start;
+    const char* text = (const char*)data + start;
+    if ((len - start >= 14 && strnicmp(text, "<!doctype html", 14) == 0) ||
+        (len - start >= 5 && strnicmp(text, "<html", 5) == 0)) {
+        return "html";
+    }
+    return memchr(data, 0, len) ? "bin" : "txt";
+}
@@ -0,0 +1,20 @@
+#ifndef MEMFILE_H
+#define MEMFILE_H
+
+#include <stddef.h>
+
+/* Anonymous in-memory files, used to open content piped to `aperi -` without writing it
+ * to disk. */
+
+/* Move the content of `fd` (the standard input) into a new memory file (memfd) named
+ * `name`, sealed against any further change. When `fd` is a pipe the data is spliced
+ * without passing through user space buffers. The returned descriptor is inherited by
+ * the executed command. Return -1 and print an error on failure. */
+int memfile_from_fd(int fd, const char* name);
+
+/* Return the extension of the file type recognized from its first bytes `data` (`len`
+ * bytes long): "txt" for text without a recognized signature, "bin" for unknown binary
+ * content. */
+const char* sniff_extension(const unsigned char* data, size_t len);
+
+#endif
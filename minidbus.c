@@ -0,0 +1,524 @@
+#define _GNU_SOURCE 1
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "minidbus.h"
+
+#define BUS_NAME "org.freedesktop.DBus"
+#define BUS_PATH "/org/freedesktop/DBus"
+#define BUS_INTERFACE "org.freedesktop.DBus"
+// Maximum message size allowed by the specification
+#define MAX_MESSAGE_SIZE (128 * 1024 * 1024)
+// Round `n` up to a multiple of `a` (a power of 2)
+#define ALIGN(n, a) (((n) + (a) - 1) & ~(size_t)((a) - 1))
+
+// Header field codes
+enum {
+    FPath = 1,
+    FInterface = 2,
+    FMember = 3,
+    FErrorName = 4,
+    FReplySerial = 5,
+    FDestination = 6,
+    FSender = 7,
+    FSignature = 8,
+};
+
+// Growable buffer used to marshal messages
+typedef struct Buf {
+    unsigned char* data;
+    size_t len;
+    size_t allocated;
+} Buf;
+
+// Message to send. NULL fields (and a 0 reply_serial) are omitted from the header
+typedef struct OutMessage {
+    uint8_t type;
+    const char* path;
+    const char* interface;
+    const char* member;
+    const char* error_name;
+    const char* destination;
+    const char* signature;
+    uint32_t reply_serial;
+    // marshalled body, starting at an 8 aligned offset
+    Buf body;
+} OutMessage;
+
+/* Like realloc, but print a message and exit in case of errors */
+static void* mrealloc(void* p, size_t size);
+
+/* Return 1 if the host is big endian */
+static int host_big_endian();
+
+/* Read an uint32 from `p`, swapping its bytes if `swap` */
+static uint32_t get_u32(const unsigned char* p, int swap);
+
+/* Append zero bytes to `b` up to a multiple of `alignment` */
+static void buf_pad(Buf* b, size_t alignment);
+
+/* Append `n` bytes to `b` */
+static void buf_append(Buf* b, const void* data, size_t n);
+
+/* Append the marshalled byte, uint32, string and signature values to `b` */
+static void buf_byte(Buf* b, uint8_t v);
+static void buf_u32(Buf* b, uint32_t v);
+static void buf_string(Buf* b, const char* s);
+static void buf_signature(Buf* b, const char* s);
+
+/* Append a header field with code `code` and a string like value of type `type` (`s`, `o`
+ * or `g`) to `b`, if `value` is not NULL */
+static void buf_field(Buf* b, uint8_t code, char type, const char* value);
+
+/* Write or read exactly `n` bytes. Return 0 on success */
+static int write_all(int fd, const void* data, size_t n);
+static int read_all(int fd, void* data, size_t n);
+
+/* Connect to the first unix socket of the D-Bus `address`. Return the socket or -1 */
+static int connect_address(const char* address);
+
+/* Authenticate with the EXTERNAL mechanism. Return 0 on success */
+static int authenticate(int fd);
+
+/* Send `out`, setting `serial` (if not NULL) to its serial. Return 0 on success */
+static int send_message(MiniDBus* bus, OutMessage* out, uint32_t* serial);
+
+/* Parse the header of the message `msg->data`, whose header fields are `fields_len` bytes
+ * long. Return 0 on success */
+static int parse_header(MiniDBusMessage* msg, uint32_t fields_len);
+
+/* Call the method `member` of the bus driver with the marshalled `body` of signature
+ * `signature` and wait for its reply. Method calls received in the meantime are queued
+ * for minidbus_read(), other messages are dropped. Return 0 on success */
+static int bus_call(MiniDBus* bus, const char* member, const char* signature, Buf* body,
+                    MiniDBusMessage* reply);
+
+static void* mrealloc(void* p, size_t size) {
+    void* res = realloc(p, size);
+    if (!res) {
+        fprintf(stderr, "No memory\n");
+        exit(1);
+    }
+    return res;
+}
+
+static int host_big_endian() {
+    uint32_t v = 1;
+    return *(unsigned char*)&v == 0;
+}
+
+static uint32_t get_u32(const unsigned char* p, int swap) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return swap ? __builtin_bswap32(v) : v;
+}
+
+static void buf_append(Buf* b, const void* data, size_t n) {
+    if (b->len + n > b->allocated) {
+        b->allocated = b->allocated ? b->allocated : 128;
+        while (b->len + n > b->allocated) b->allocated *= 2;
+        b->data = mrealloc(b->data, b->allocated);
+    }
+    if (data) {
+        memcpy(b->data + b->len, data, n);
+    } else {
+        memset(b->data + b->len, 0, n);
+    }
+    b->len += n;
+}
+
+static void buf_pad(Buf* b, size_t alignment) {
+    buf_append(b, NULL, ALIGN(b->len, alignment) - b->len);
+}
+
+static void buf_byte(Buf* b, uint8_t v) {
+    buf_append(b, &v, 1);
+}
+
+static void buf_u32(Buf* b, uint32_t v) {
+    buf_pad(b, 4);
+    buf_append(b, &v, 4);
+}
+
+static void buf_string(Buf* b, const char* s) {
+    uint32_t ln = strlen(s);
+    buf_u32(b, ln);
+    buf_append(b, s, ln + 1);
+}
+
+static void buf_signature(Buf* b, const char* s) {
+    uint8_t ln = strlen(s);
+    buf_byte(b, ln);
+    buf_append(b, s, ln + 1);
+}
+
+static void buf_field(Buf* b, uint8_t code, char type, const char* value) {
+    if (!value) return;
+    char signature[2] = {type, 0};
+    buf_pad(b, 8);
+    buf_byte(b, code);
+    buf_signature(b, signature);
+    if (type == 'g') {
+        buf_signature(b, value);
+    } else {
+        buf_string(b, value);
+    }
+}
+
+static int write_all(int fd, const void* data, size_t n) {
+    const char* p = data;
+    while (n > 0) {
+        ssize_t res = write(fd, p, n);
+        if (res < 0 && errno == EINTR) continue;
+        if (res <= 0) return -1;
+        p += res;
+        n -= res;
+    }
+    return 0;
+}
+
+static int read_all(int fd, void* data, size_t n) {
+    char* p = data;
+    while (n > 0) {
+        ssize_t res = read(fd, p, n);
+        if (res < 0 && errno == EINTR) continue;
+        if (res <= 0) return -1;
+        p += res;
+        n -= res;
+    }
+    return 0;
+}
+
+static int connect_address(const char* address) {
+    const char* entry = address;
+    while (*entry) {
+        const char* entry_end = strchrnul(entry, ';');
+        if (strncmp(entry, "unix:", 5) == 0) {
+            struct sockaddr_un sa;
+            memset(&sa, 0, sizeof(sa));
+            sa.sun_family = AF_UNIX;
+            int abstract = -1;
+            size_t ln = 0;
+            // key=value pairs separated by commas, values are percent encoded
+            const char* c = entry + 5;
+            while (c < entry_end) {
+                const char* pair_end = c;
+                while (pair_end < entry_end && *pair_end != ',') ++pair_end;
+                int is_path = strncmp(c, "path=", 5) == 0;
+                int is_abstract = strncmp(c, "abstract=", 9) == 0;
+                if (is_path || is_abstract) {
+                    abstract = is_abstract;
+                    ln = abstract;
+                    for (c += is_path ? 5 : 9; c < pair_end && ln < sizeof(sa.sun_path) - 1;
+                         ++c) {
+                        unsigned int v;
+                        if (*c == '%' && pair_end - c > 2 && sscanf(c + 1, "%2x", &v) == 1) {
+                            sa.sun_path[ln++] = v;
+                            c += 2;
+                        } else {
+                            sa.sun_path[ln++] = *c;
+                        }
+                    }
+                }
+                c = pair_end + 1;
+            }
+            if (abstract >= 0) {
+                int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+                // the path of abstract sockets isn't nul terminated
+                socklen_t sa_len = offsetof(struct sockaddr_un, sun_path) + ln + !abstract;
+                if (fd >= 0 && connect(fd, (struct sockaddr*)&sa, sa_len) == 0) return fd;
+                if (fd >= 0) close(fd);
+            }
+        }
+        if (!*entry_end) break;
+        entry = entry_end + 1;
+    }
+    return -1;
+}
+
+static int authenticate(int fd) {
+    // a nul byte (for the credentials), then AUTH EXTERNAL with the hex encoded uid
+    char cmd[64] = {0};
+    char uid[16];
+    snprintf(uid, sizeof(uid), "%u", (unsigned)getuid());
+    char* p = stpcpy(cmd + 1, "AUTH EXTERNAL ");
+    for (char* c = uid; *c; ++c) p += sprintf(p, "%02x", (unsigned char)*c);
+    p = stpcpy(p, "\r\n");
+    if (write_all(fd, cmd, p - cmd)) return -1;
+    char line[256];
+    size_t ln = 0;
+    while (ln < sizeof(line) - 1) {
+        if (read_all(fd, &line[ln], 1)) return -1;
+        if (line[ln++] == '\n') break;
+    }
+    line[ln] = 0;
+    if (strncmp(line, "OK ", 3) != 0) {
+        fprintf(stderr, "D-Bus authentication failed: %s", line);
+        return -1;
+    }
+    return write_all(fd, "BEGIN\r\n", 7);
+}
+
+static int send_message(MiniDBus* bus, OutMessage* out, uint32_t* serial) {
+    Buf b = {NULL, 0, 0};
+    uint32_t msg_serial = ++bus->serial;
+    buf_byte(&b, host_big_endian() ? 'B' : 'l');
+    buf_byte(&b, out->type);
+    buf_byte(&b, 0);
+    buf_byte(&b, 1);
+    buf_u32(&b, out->body.len);
+    buf_u32(&b, msg_serial);
+    // length of the header fields array, set below
+    buf_u32(&b, 0);
+    buf_field(&b, FPath, 'o', out->path);
+    buf_field(&b, FInterface, 's', out->interface);
+    buf_field(&b, FMember, 's', out->member);
+    buf_field(&b, FErrorName, 's', out->error_name);
+    buf_field(&b, FDestination, 's', out->destination);
+    buf_field(&b, FSignature, 'g', out->signature);
+    if (out->reply_serial) {
+        buf_pad(&b, 8);
+        buf_byte(&b, FReplySerial);
+        buf_signature(&b, "u");
+        buf_u32(&b, out->reply_serial);
+    }
+    uint32_t fields_len = b.len - 16;
+    memcpy(b.data + 12, &fields_len, 4);
+    buf_pad(&b, 8);
+    buf_append(&b, out->body.data, out->body.len);
+    int res = write_all(bus->fd, b.data, b.len);
+    free(b.data);
+    if (serial) *serial = msg_serial;
+    return res;
+}
+
+static int parse_header(MiniDBusMessage* msg, uint32_t fields_len) {
+    const unsigned char* d = msg->data;
+    size_t pos = 16;
+    size_t end = 16 + (size_t)fields_len;
+    while (pos < end) {
+        pos = ALIGN(pos, 8);
+        if (pos + 4 > end) return -1;
+        uint8_t code = d[pos++];
+        // variant signature: a single basic type
+        if (d[pos] != 1 || d[pos + 2] != 0) return -1;
+        char type = d[pos + 1];
+        pos += 3;
+        const char* str = NULL;
+        uint32_t value = 0;
+        if (type == 's' || type == 'o') {
+            pos = ALIGN(pos, 4);
+            if (pos + 4 > end) return -1;
+            uint32_t ln = get_u32(d + pos, msg->swap);
+            pos += 4;
+            if (ln >= end - pos || d[pos + ln] != 0) return -1;
+            str = (const char*)d + pos;
+            pos += ln + 1;
+        } else if (type == 'g') {
+            if (pos >= end) return -1;
+            uint8_t ln = d[pos++];
+            if (ln >= end - pos || d[pos + ln] != 0) return -1;
+            str = (const char*)d + pos;
+            pos += ln + 1;
+        } else if (type == 'u') {
+            pos = ALIGN(pos, 4);
+            if (pos + 4 > end) return -1;
+            value = get_u32(d + pos, msg->swap);
+            pos += 4;
+        } else {
+            return -1;
+        }
+        switch (code) {
+            case FPath: msg->path = str; break;
+            case FInterface: msg->interface = str; break;
+            case FMember: msg->member = str; break;
+            case FErrorName: msg->error_name = str; break;
+            case FReplySerial: msg->reply_serial = value; break;
+            case FDestination: msg->destination = str; break;
+            case FSender: msg->sender = str; break;
+            case FSignature: msg->signature = str; break;
+        }
+    }
+    return 0;
+}
+
+static int bus_call(MiniDBus* bus, const char* member, const char* signature, Buf* body,
+                    MiniDBusMessage* reply) {
+    OutMessage out = {MINIDBUS_METHOD_CALL, BUS_PATH, BUS_INTERFACE, member, NULL, BUS_NAME,
+                      signature, 0, *body};
+    uint32_t serial;
+    if (send_message(bus, &out, &serial)) return -1;
+    while (1) {
+        if (minidbus_read(bus, reply)) return -1;
+        if ((reply->type == MINIDBUS_METHOD_RETURN || reply->type == MINIDBUS_ERROR) &&
+            reply->reply_serial == serial) {
+            break;
+        }
+        if (reply->type == MINIDBUS_METHOD_CALL) {
+            bus->queued = mrealloc(bus->queued,
+                                   (bus->n_queued + 1) * sizeof(MiniDBusMessage));
+            bus->queued[bus->n_queued++] = *reply;
+        } else {
+            minidbus_message_free(reply);
+        }
+    }
+    if (reply->type == MINIDBUS_ERROR) {
+        fprintf(stderr, "%s failed: %s\n", member,
+                reply->error_name ? reply->error_name : "unknown error");
+        minidbus_message_free(reply);
+        return -1;
+    }
+    return 0;
+}
+
+int minidbus_open_session(MiniDBus* bus) {
+    memset(bus, 0, sizeof(MiniDBus));
+    bus->fd = -1;
+    const char* address = getenv("DBUS_SESSION_BUS_ADDRESS");
+    char* fallback = NULL;
+    if (!address || !*address) {
+        const char* runtime_dir = getenv("XDG_RUNTIME_DIR");
+        if (runtime_dir && asprintf(&fallback, "unix:path=%s/bus", runtime_dir) > 0) {
+            address = fallback;
+        }
+    }
+    if (address) bus->fd = connect_address(address);
+    free(fallback);
+    if (bus->fd < 0) {
+        fprintf(stderr, "Couldn't connect to the session bus\n");
+        return -1;
+    }
+    if (authenticate(bus->fd)) {
+        minidbus_close(bus);
+        return -1;
+    }
+    Buf body = {NULL, 0, 0};
+    MiniDBusMessage reply;
+    if (bus_call(bus, "Hello", NULL, &body, &reply)) {
+        minidbus_close(bus);
+        return -1;
+    }
+    if (reply.signature && strcmp(reply.signature, "s") == 0 && reply.body_len > 4) {
+        uint32_t ln = get_u32(reply.body, reply.swap);
+        if (ln < reply.body_len - 4) bus->unique_name = strndup((char*)reply.body + 4, ln);
+    }
+    minidbus_message_free(&reply);
+    return 0;
+}
+
+void minidbus_close(MiniDBus* bus) {
+    if (bus->fd >= 0) close(bus->fd);
+    bus->fd = -1;
+    free(bus->unique_name);
+    bus->unique_name = NULL;
+    for (int i = 0; i < bus->n_queued; ++i) minidbus_message_free(&bus->queued[i]);
+    free(bus->queued);
+    bus->queued = NULL;
+    bus->n_queued = 0;
+}
+
+int minidbus_request_name(MiniDBus* bus, const char* name, uint32_t flags, uint32_t* reply) {
+    Buf body = {NULL, 0, 0};
+    buf_string(&body, name);
+    buf_u32(&body, flags);
+    MiniDBusMessage msg;
+    int res = bus_call(bus, "RequestName", "su", &body, &msg);
+    free(body.data);
+    if (res) return -1;
+    res = -1;
+    if (msg.signature && strcmp(msg.signature, "u") == 0 && msg.body_len >= 4) {
+        *reply = get_u32(msg.body, msg.swap);
+        res = 0;
+    }
+    minidbus_message_free(&msg);
+    return res;
+}
+
+int minidbus_read(MiniDBus* bus, MiniDBusMessage* msg) {
+    if (bus->n_queued > 0) {
+        *msg = bus->queued[0];
+        memmove(bus->queued, bus->queued + 1, --bus->n_queued * sizeof(MiniDBusMessage));
+        return 0;
+    }
+    memset(msg, 0, sizeof(MiniDBusMessage));
+    unsigned char fixed[16];
+    if (read_all(bus->fd, fixed, 16)) return -1;
+    if ((fixed[0] != 'l' && fixed[0] != 'B') || fixed[3] != 1) return -1;
+    msg->swap = (fixed[0] == 'B') != host_big_endian();
+    uint32_t body_len = get_u32(fixed + 4, msg->swap);
+    uint32_t fields_len = get_u32(fixed + 12, msg->swap);
+    if (body_len > MAX_MESSAGE_SIZE || fields_len > MAX_MESSAGE_SIZE) return -1;
+    size_t header_len = ALIGN(16 + (size_t)fields_len, 8);
+    size_t total = header_len + body_len;
+    if (total > MAX_MESSAGE_SIZE) return -1;
+    msg->data = mrealloc(NULL, total);
+    memcpy(msg->data, fixed, 16);
+    if (read_all(bus->fd, msg->data + 16, total - 16) || parse_header(msg, fields_len)) {
+        minidbus_message_free(msg);
+        return -1;
+    }
+    msg->type = fixed[1];
+    msg->flags = fixed[2];
+    msg->serial = get_u32(fixed + 8, msg->swap);
+    msg->body = msg->data + header_len;
+    msg->body_len = body_len;
+    return 0;
+}
+
+void minidbus_message_free(MiniDBusMessage* msg) {
+    free(msg->data);
+    msg->data = NULL;
+}
+
+int minidbus_read_string_array(const MiniDBusMessage* msg, const char*** strings) {
+    if (!msg->signature || strncmp(msg->signature, "as", 2) != 0 || msg->body_len < 4) {
+        return -1;
+    }
+    const unsigned char* b = msg->body;
+    uint32_t array_len = get_u32(b, msg->swap);
+    // strings are 4 aligned, like the array length: there's no padding before them
+    size_t pos = 4;
+    if (array_len > msg->body_len - pos) return -1;
+    size_t end = pos + array_len;
+    int n = 0;
+    const char** res = mrealloc(NULL, sizeof(char*));
+    while (pos < end) {
+        pos = ALIGN(pos, 4);
+        if (pos + 4 > end) break;
+        uint32_t ln = get_u32(b + pos, msg->swap);
+        pos += 4;
+        if (ln >= end - pos || b[pos + ln] != 0) break;
+        res = mrealloc(res, (n + 2) * sizeof(char*));
+        res[n++] = (const char*)b + pos;
+        pos += ln + 1;
+    }
+    if (pos < end) {
+        free(res);
+        return -1;
+    }
+    res[n] = NULL;
+    *strings = res;
+    return 0;
+}
+
+int minidbus_reply(MiniDBus* bus, const MiniDBusMessage* call) {
+    if (call->flags & MINIDBUS_NO_REPLY_EXPECTED) return 0;
+    OutMessage out = {MINIDBUS_METHOD_RETURN, NULL, NULL, NULL, NULL, call->sender, NULL,
+                      call->serial, {NULL, 0, 0}};
+    return send_message(bus, &out, NULL);
+}
+
+int minidbus_reply_error(MiniDBus* bus, const MiniDBusMessage* call, const char* name,
+                         const char* text) {
+    if (call->flags & MINIDBUS_NO_REPLY_EXPECTED) return 0;
+    OutMessage out = {MINIDBUS_ERROR, NULL, NULL, NULL, name, call->sender, "s",
+                      call->serial, {NULL, 0, 0}};
+    buf_string(&out.body, text);
+    int res = send_message(bus, &out, NULL);
+    free(out.body.data);
+    return res;
+}
@@ -0,0 +1,95 @@
+#ifndef MINIDBUS_H
+#define MINIDBUS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Minimal D-Bus client speaking the wire protocol directly, used by aperi_fm1 instead of
+ * libdbus when built with `-Ddbus=native`.
+ *
+ * It supports only what a service owning a name and answering simple method calls needs:
+ * connecting to the session bus through a unix socket with the EXTERNAL authentication,
+ * Hello, RequestName, reading messages with string and string array arguments and sending
+ * empty method returns and errors. Messages are read and written synchronously. */
+
+// Message types
+#define MINIDBUS_METHOD_CALL 1
+#define MINIDBUS_METHOD_RETURN 2
+#define MINIDBUS_ERROR 3
+#define MINIDBUS_SIGNAL 4
+
+// Message flags
+#define MINIDBUS_NO_REPLY_EXPECTED 0x1
+
+// RequestName flags and replies
+#define MINIDBUS_NAME_FLAG_REPLACE_EXISTING 0x2
+#define MINIDBUS_NAME_PRIMARY_OWNER 1
+
+typedef struct MiniDBus {
+    // socket connected to the bus
+    int fd;
+    // serial of the last message sent
+    uint32_t serial;
+    // unique name assigned by the bus
+    char* unique_name;
+    // method calls received while waiting for the reply of a bus call
+    struct MiniDBusMessage* queued;
+    int n_queued;
+} MiniDBus;
+
+typedef struct MiniDBusMessage {
+    uint8_t type;
+    uint8_t flags;
+    uint32_t serial;
+    uint32_t reply_serial;
+    // header fields (NULL if missing). They point inside `data`
+    const char* path;
+    const char* interface;
+    const char* member;
+    const char* error_name;
+    const char* destination;
+    const char* sender;
+    const char* signature;
+    // message body
+    const unsigned char* body;
+    uint32_t body_len;
+    // the message is in a different byte order than the host one
+    int swap;
+    // the whole message, as read from the bus
+    unsigned char* data;
+} MiniDBusMessage;
+
+/* Connect to the session bus ($DBUS_SESSION_BUS_ADDRESS, or `$XDG_RUNTIME_DIR/bus`),
+ * authenticate and register the connection. Return 0 on success, else print an error and
+ * return -1. */
+int minidbus_open_session(MiniDBus* bus);
+
+/* Close the connection and free its resources */
+void minidbus_close(MiniDBus* bus);
+
+/* Request the well known name `name` with the RequestName `flags` and set `reply` to the
+ * bus reply (MINIDBUS_NAME_PRIMARY_OWNER...). Return 0 on success. */
+int minidbus_request_name(MiniDBus* bus, const char* name, uint32_t flags, uint32_t* reply);
+
+/* Wait for the next message and read it in `msg`, to be freed with minidbus_message_free().
+ * Return 0 on success, -1 if the connection was closed or it's broken. */
+int minidbus_read(MiniDBus* bus, MiniDBusMessage* msg);
+
+/* Free the memory allocated for `msg` */
+void minidbus_message_free(MiniDBusMessage* msg);
+
+/* Read the first argument of `msg`, that must be a string array (signature starting with
+ * `as`). `strings` is set to a NULL terminated array of pointers inside the message, to be
+ * freed with free(). Return 0 on success, -1 if the argument is missing or invalid. */
+int minidbus_read_string_array(const MiniDBusMessage* msg, const char*** strings);
+
+/* Send an empty method return for the method call `call`, unless the caller doesn't expect
+ * a reply. Return 0 on success. */
+int minidbus_reply(MiniDBus* bus, const MiniDBusMessage* call);
+
+/* Send the error `name` with the message `text` for the method call `call`, unless the
+ * caller doesn't expect a reply. Return 0 on success. */
+int minidbus_reply_error(MiniDBus* bus, const MiniDBusMessage* call, const char* name,
+                         const char* text);
+
+#endif
@@ -0,0 +1,206 @@
+#define _GNU_SOURCE 1
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include "modifiers.h"
+#include "util.h"
+
+// ioprio_set(2) constants, not exported by the C library
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_RT 1
+#define IOPRIO_CLASS_BE 2
+#define IOPRIO_CLASS_IDLE 3
+
+/* Parse the integer `s` in [`min`, `max`] into `res`. Return 0 on success. */
+static int parse_int(const char* s, long min, long max, long* res);
+
+/* Parse a CPU list (like `0-3,6`) into `cpus`. Return 0 on success. */
+static int parse_cpus(const char* s, cpu_set_t* cpus);
+
+/* Parse an I/O priority (`<class>[:<level>]`) into `ioprio`. Return 0 on success. */
+static int parse_ioprio(const char* s, int* ioprio);
+
+/* Set both the soft and hard `resource` limit to `value` */
+static void set_limit(int resource, rlim_t value, const char* name);
+
+static int parse_int(const char* s, long min, long max, long* res) {
+    char* end;
+    errno = 0;
+    long v = strtol(s, &end, 10);
+    if (errno || end == s || *end || v < min || v > max) return 1;
+    *res = v;
+    return 0;
+}
+
+static int parse_cpus(const char* s, cpu_set_t* cpus) {
+    CPU_ZERO(cpus);
+    while (*s) {
+        char* end;
+        long from = strtol(s, &end, 10);
+        if (end == s || from < 0) return 1;
+        long to = from;
+        if (*end == '-') {
+            s = end + 1;
+            to = strtol(s, &end, 10);
+            if (end == s || to < from) return 1;
+        }
+        if (to >= CPU_SETSIZE) return 1;
+        for (long cpu = from; cpu <= to; ++cpu) CPU_SET(cpu, cpus);
+        if (*end == ',') {
+            ++end;
+        } else if (*end) {
+            return 1;
+        }
+        s = end;
+    }
+    return CPU_COUNT(cpus) == 0;
+}
+
+static int parse_ioprio(const char* s, int* ioprio) {
+    int class;
+    long level = 4;
+    const char* colon = strchr(s, ':');
+    size_t ln = colon ? (size_t)(colon - s) : strlen(s);
+    if (ln == 2 && strncmp(s, "rt", 2) == 0) {
+        class = IOPRIO_CLASS_RT;
+    } else if (ln == 2 && strncmp(s, "be", 2) == 0) {
+        class = IOPRIO_CLASS_BE;
+    } else if (ln == 4 && strncmp(s, "idle", 4) == 0) {
+        class = IOPRIO_CLASS_IDLE;
+        level = 0;
+    } else {
+        return 1;
+    }
+    if (colon && parse_int(colon + 1, 0, 7, &level)) return 1;
+    *ioprio = class << IOPRIO_CLASS_SHIFT | (int)level;
+    return 0;
+}
+
+void modifiers_init(Modifiers* modifiers) {
+    memset(modifiers, 0, sizeof(Modifiers));
+}
+
+void modifiers_free(Modifiers* modifiers) {
+    free(modifiers->copy);
+    free(modifiers->cwd);
+    free(modifiers->server);
+    free(modifiers->socket);
+    modifiers_init(modifiers);
+}
+
+int modifiers_parse(Modifiers* modifiers, const char* modifier) {
+    const char* eq = strchr(modifier, '=');
+    if (!eq) return 1;
+    size_t ln = eq - modifier;
+    const char* value = eq + 1;
+    long v;
+    unsigned long long size;
+    if (ln == 4 && strncmp(modifier, "nice", 4) == 0) {
+        if (parse_int(value, -20, 19, &v)) return 1;
+        modifiers->nice = v;
+        modifiers->set |= MNice;
+    } else if (ln == 6 && strncmp(modifier, "ioprio", 6) == 0) {
+        if (parse_ioprio(value, &modifiers->ioprio)) return 1;
+        modifiers->set |= MIOPrio;
+    } else if (ln == 4 && strncmp(modifier, "cpus", 4) == 0) {
+        if (parse_cpus(value, &modifiers->cpus)) return 1;
+        modifiers->set |= MCPUs;
+    } else if (ln == 2 && strncmp(modifier, "as", 2) == 0) {
+        if (parse_size(value, &size)) return 1;
+        modifiers->as = size;
+        modifiers->set |= MAS;
+    } else if (ln == 6 && strncmp(modifier, "nofile", 6) == 0) {
+        if (parse_size(value, &size)) return 1;
+        modifiers->nofile = size;
+        modifiers->set |= MNoFile;
+    } else if (ln == 8 && strncmp(modifier, "prefetch", 8) == 0) {
+        if (parse_size(value, &size)) return 1;
+        modifiers->prefetch = size;
+        modifiers->set |= MPrefetch;
+    } else if (ln == 3 && strncmp(modifier, "oom", 3) == 0) {
+        if (parse_int(value, -1000, 1000, &v)) return 1;
+        modifiers->oom_score_adj = v;
+        modifiers->set |= MOOMScoreAdj;
+    } else if (ln == 4 && strncmp(modifier, "copy", 4) == 0) {
+        free(modifiers->copy);
+        modifiers->copy = strdup(value);
+        modifiers->set |= MCopy;
+    } else if (ln == 3 && strncmp(modifier, "cwd", 3) == 0) {
+        free(modifiers->cwd);
+        modifiers->cwd = strdup(value);
+        modifiers->set |= MCwd;
+    } else if (ln == 6 && strncmp(modifier, "server", 6) == 0 && *value) {
+        free(modifiers->server);
+        modifiers->server = strdup(value);
+        modifiers->set |= MServer;
+    } else if (ln == 6 && strncmp(modifier, "socket", 6) == 0 && *value) {
+        free(modifiers->socket);
+        modifiers->socket = strdup(value);
+        modifiers->set |= MSocket;
+    } else {
+        return 1;
+    }
+    return 0;
+}
+
+static void set_limit(int resource, rlim_t value, const char* name) {
+    // only the soft limit: lowering the hard one couldn't be undone
+    struct rlimit limit;
+    int res = getrlimit(resource, &limit);
+    if (res == 0) {
+        limit.rlim_cur = value;
+        res = setrlimit(resource, &limit);
+    }
+    if (res != 0) {
+        fprintf(stderr, "Couldn't set the %s limit: %s\n", name, strerror(errno));
+    }
+}
+
+void prefetch_file(const char* path, off_t length) {
+    pid_t pid = fork();
+    if (pid < 0) return;
+    if (pid > 0) {
+        waitpid(pid, NULL, 0);
+        return;
+    }
+    // fork again so that the helper is reparented and never becomes a zombie of the command
+    if (fork() != 0) _exit(0);
+    setsid();
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        // the advice starts the readahead, readahead() waits for the pages not queued by it
+        posix_fadvise(fd, 0, length, POSIX_FADV_WILLNEED);
+        readahead(fd, 0, length);
+        close(fd);
+    }
+    _exit(0);
+}
+
+void modifiers_apply(const Modifiers* modifiers) {
+    if (modifiers->set & MNice && setpriority(PRIO_PROCESS, 0, modifiers->nice) != 0) {
+        fprintf(stderr, "Couldn't set the nice level: %s\n", strerror(errno));
+    }
+    if (modifiers->set & MIOPrio &&
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, modifiers->ioprio) != 0) {
+        fprintf(stderr, "Couldn't set the I/O priority: %s\n", strerror(errno));
+    }
+    if (modifiers->set & MCPUs &&
+        sched_setaffinity(0, sizeof(cpu_set_t), &modifiers->cpus) != 0) {
+        fprintf(stderr, "Couldn't set the CPU affinity: %s\n", strerror(errno));
+    }
+    if (modifiers->set & MAS) set_limit(RLIMIT_AS, modifiers->as, "address space");
+    if (modifiers->set & MNoFile) set_limit(RLIMIT_NOFILE, modifiers->nofile, "open files");
+    if (modifiers->set & MOOMScoreAdj) {
+        FILE* f = fopen("/proc/self/oom_score_adj", "w");
+        int failed = !f || fprintf(f, "%d", modifiers->oom_score_adj) < 0;
+        if ((f && fclose(f) != 0) || failed) {
+            fprintf(stderr, "Couldn't set the OOM score adjustment: %s\n", strerror(errno));
+        }
+    }
+}
@@ -0,0 +1,85 @@
+#ifndef MODIFIERS_H
+#define MODIFIERS_H
+
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+
+/* Rule modifiers: optional `key=value` attributes written between square brackets right
+ * after the `=` of a rule, like `mkv=[nice=10 ioprio=idle]mpv`. They control how the
+ * command of the rule is launched. */
+
+// Modifiers set for a rule
+typedef enum ModifierFlag {
+    MNice = 1 << 0,
+    MIOPrio = 1 << 1,
+    MCPUs = 1 << 2,
+    MAS = 1 << 3,
+    MNoFile = 1 << 4,
+    MOOMScoreAdj = 1 << 5,
+    MPrefetch = 1 << 6,
+    MCopy = 1 << 7,
+    MCwd = 1 << 8,
+    MServer = 1 << 9,
+    MSocket = 1 << 10,
+    // modifiers changing the process itself, not undone if the command can't be executed
+    MProcess = MNice | MIOPrio | MCPUs | MAS | MNoFile | MOOMScoreAdj,
+} ModifierFlag;
+
+typedef struct Modifiers {
+    // ModifierFlag bits of the modifiers set
+    unsigned set;
+    // nice level
+    int nice;
+    // I/O priority, as passed to ioprio_set (class << 13 | level)
+    int ioprio;
+    // CPU affinity mask
+    cpu_set_t cpus;
+    // RLIMIT_AS and RLIMIT_NOFILE
+    rlim_t as;
+    rlim_t nofile;
+    // /proc/self/oom_score_adj value
+    int oom_score_adj;
+    // bytes at the beginning of the argument file to read in the page cache
+    off_t prefetch;
+    // templates (with placeholders) of the text to copy to the clipboard and of the
+    // working directory of the command
+    char* copy;
+    char* cwd;
+    // server command and its socket, for client commands (see warmpool.h)
+    char* server;
+    char* socket;
+} Modifiers;
+
+/* Reset `modifiers` to no modifiers */
+void modifiers_init(Modifiers* modifiers);
+
+/* Free the memory allocated for `modifiers` and reset them to no modifiers */
+void modifiers_free(Modifiers* modifiers);
+
+/* Parse the modifier `modifier` (in the form `key=value`) and set it in `modifiers`.
+ * Return 0 on success, 1 if the modifier is unknown or its value invalid. Supported
+ * modifiers are:
+ *  nice=<-20..19>
+ *  ioprio=<rt|be|idle>[:<0..7>]
+ *  cpus=<cpu list, like 0-3,6>
+ *  as=<bytes, with optional K/M/G/T suffix>
+ *  nofile=<number of files>
+ *  oom=<-1000..1000>
+ *  prefetch=<bytes, with optional K/M/G/T suffix>
+ *  copy=<template>
+ *  cwd=<template>
+ *  server=<command>
+ *  socket=<path>
+ * Templates are stored as they are: their placeholders are expanded by the caller. */
+int modifiers_parse(Modifiers* modifiers, const char* modifier);
+
+/* Start reading the first `length` bytes of the file `path` in the page cache, in a
+ * detached process, so that the command can start while the data is being read */
+void prefetch_file(const char* path, off_t length);
+
+/* Apply the modifiers to the current process, that is going to exec the command. Errors
+ * are reported but not fatal. */
+void modifiers_apply(const Modifiers* modifiers);
+
+#endif
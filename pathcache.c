@@ -0,0 +1,229 @@
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "pathcache.h"
+#include "util.h"
+
+#define CACHE_NAME "path.cache"
+#define CACHE_MAGIC "aperi-path-cache 1\n"
+// PATH used by execvp() when the variable is not set
+#define DEFAULT_PATH "/bin:/usr/bin"
+
+typedef struct PathDir {
+    char* path;
+    // modification time recorded in the cache (-1 seconds if the directory is missing)
+    long long sec;
+    long nsec;
+} PathDir;
+
+typedef struct PathCache {
+    // directories of PATH, in order
+    PathDir* dirs;
+    int n_dirs;
+    // cached executable names and the index of the directory containing them
+    char** names;
+    int* name_dirs;
+    int n_names;
+} PathCache;
+
+/* Fill cache->dirs with the directories of `path_env`, with unknown modification times */
+static void cache_split_path(PathCache* cache, const char* path_env);
+
+/* Load the cache file `cache_path`. Return 1 if it was found and built for `path_env` */
+static int cache_load(PathCache* cache, const char* cache_path, const char* path_env);
+
+/* Save the cache to `cache_path` */
+static void cache_save(const PathCache* cache, const char* cache_path, const char* path_env);
+
+/* Free the memory allocated for the cache */
+static void cache_free(PathCache* cache);
+
+/* Stat `dir` and update its modification time. Return 1 if it changed. */
+static int dir_refresh(PathDir* dir);
+
+/* Return 1 if `path` is an executable regular file */
+static int is_executable(const char* path);
+
+/* Return `dir`/`name`. The result must be freed. */
+static char* join(const char* dir, const char* name);
+
+static void cache_split_path(PathCache* cache, const char* path_env) {
+    int n = 1;
+    for (const char* c = path_env; *c; ++c) n += *c == ':';
+    cache->dirs = xmalloc(n * sizeof(PathDir));
+    cache->n_dirs = 0;
+    const char* start = path_env;
+    while (1) {
+        const char* end = strchrnul(start, ':');
+        PathDir* dir = &cache->dirs[cache->n_dirs++];
+        // an empty entry is the current directory
+        dir->path = end > start ? strndup(start, end - start) : strdup(".");
+        dir->sec = -2;
+        dir->nsec = 0;
+        if (!*end) break;
+        start = end + 1;
+    }
+}
+
+static int cache_load(PathCache* cache, const char* cache_path, const char* path_env) {
+    FILE* f = fopen(cache_path, "r");
+    if (!f) return 0;
+    char* line = NULL;
+    size_t allocated = 0;
+    ssize_t ln;
+    int valid = getline(&line, &allocated, f) > 0 && strcmp(line, CACHE_MAGIC) == 0;
+    if (valid) {
+        ln = getline(&line, &allocated, f);
+        valid = ln > 2 && line[0] == 'P' && line[ln-1] == '\n' &&
+                strlen(path_env) == (size_t)(ln - 3) &&
+                strncmp(line + 2, path_env, ln - 3) == 0;
+    }
+    if (valid) {
+        cache_split_path(cache, path_env);
+        int n_dirs = 0;
+        while ((ln = getline(&line, &allocated, f)) > 0) {
+            if (line[ln-1] == '\n') line[--ln] = 0;
+            long long sec;
+            long nsec;
+            int dir;
+            int start;
+            if (line[0] == 'D' && n_dirs < cache->n_dirs &&
+                sscanf(line, "D %lld %ld", &sec, &nsec) == 2) {
+                cache->dirs[n_dirs].sec = sec;
+                cache->dirs[n_dirs].nsec = nsec;
+                ++n_dirs;
+            } else if (line[0] == 'E' && sscanf(line, "E %d %n", &dir, &start) == 1 &&
+                       dir >= 0 && dir < cache->n_dirs) {
+                cache->names = xrealloc(cache->names, (cache->n_names + 1) * sizeof(char*));
+                cache->name_dirs = xrealloc(cache->name_dirs,
+                                            (cache->n_names + 1) * sizeof(int));
+                cache->names[cache->n_names] = strdup(line + start);
+                cache->name_dirs[cache->n_names++] = dir;
+            }
+        }
+        valid = n_dirs == cache->n_dirs;
+    }
+    free(line);
+    fclose(f);
+    return valid;
+}
+
+static void cache_save(const PathCache* cache, const char* cache_path, const char* path_env) {
+    char* tmppath;
+    FILE* f = atomic_open(cache_path, &tmppath);
+    if (!f) return;
+    fputs(CACHE_MAGIC, f);
+    fprintf(f, "P %s\n", path_env);
+    for (int i = 0; i < cache->n_dirs; ++i) {
+        fprintf(f, "D %lld %ld\n", cache->dirs[i].sec, cache->dirs[i].nsec);
+    }
+    for (int i = 0; i < cache->n_names; ++i) {
+        fprintf(f, "E %d %s\n", cache->name_dirs[i], cache->names[i]);
+    }
+    atomic_commit(f, tmppath, cache_path);
+}
+
+static void cache_free(PathCache* cache) {
+    for (int i = 0; i < cache->n_dirs; ++i) free(cache->dirs[i].path);
+    free(cache->dirs);
+    for (int i = 0; i < cache->n_names; ++i) free(cache->names[i]);
+    free(cache->names);
+    free(cache->name_dirs);
+}
+
+static int dir_refresh(PathDir* dir) {
+    struct stat statbuf;
+    long long sec = -1;
+    long nsec = 0;
+    if (stat(dir->path, &statbuf) == 0) {
+        sec = statbuf.st_mtim.tv_sec;
+        nsec = statbuf.st_mtim.tv_nsec;
+    }
+    int changed = sec != dir->sec || nsec != dir->nsec;
+    dir->sec = sec;
+    dir->nsec = nsec;
+    return changed;
+}
+
+static int is_executable(const char* path) {
+    struct stat statbuf;
+    return stat(path, &statbuf) == 0 && S_ISREG(statbuf.st_mode) && access(path, X_OK) == 0;
+}
+
+static char* join(const char* dir, const char* name) {
+    char* res = xmalloc(strlen(dir) + strlen(name) + 2);
+    stpcpy(stpcpy(stpcpy(res, dir), "/"), name);
+    return res;
+}
+
+char* path_lookup(const char* name) {
+    if (strchr(name, '/')) return strdup(name);
+    if (!*name) return NULL;
+    const char* path_env = getenv("PATH");
+    if (!path_env) path_env = DEFAULT_PATH;
+    char* cache_path = xdg_aperi_path("XDG_CACHE_HOME", ".cache", CACHE_NAME);
+    PathCache cache = {NULL, 0, NULL, NULL, 0};
+    int loaded = cache_load(&cache, cache_path, path_env);
+
+    // fast path: the cached directory and the ones before it are unchanged
+    int cached = -1;
+    for (int i = 0; loaded && i < cache.n_names; ++i) {
+        if (strcmp(cache.names[i], name) == 0) {
+            cached = i;
+            break;
+        }
+    }
+    if (cached >= 0) {
+        int valid = 1;
+        for (int i = 0; valid && i <= cache.name_dirs[cached]; ++i) {
+            valid = !dir_refresh(&cache.dirs[i]);
+        }
+        if (valid) {
+            char* res = join(cache.dirs[cache.name_dirs[cached]].path, name);
+            cache_free(&cache);
+            free(cache_path);
+            return res;
+        }
+    }
+
+    // slow path: search the executable as execvp() would, refreshing all the directories
+    if (!loaded) {
+        cache_free(&cache);
+        memset(&cache, 0, sizeof(cache));
+        cache_split_path(&cache, path_env);
+    }
+    int changed = !loaded;
+    char* res = NULL;
+    int found_dir = -1;
+    for (int i = 0; i < cache.n_dirs; ++i) {
+        changed |= dir_refresh(&cache.dirs[i]);
+        if (found_dir < 0) {
+            char* candidate = join(cache.dirs[i].path, name);
+            if (is_executable(candidate)) {
+                res = candidate;
+                found_dir = i;
+            } else {
+                free(candidate);
+            }
+        }
+    }
+    // some directory changed: the other cached names may be stale too
+    if (changed || cached >= 0) {
+        for (int i = 0; i < cache.n_names; ++i) free(cache.names[i]);
+        cache.n_names = 0;
+    }
+    if (found_dir >= 0) {
+        cache.names = xrealloc(cache.names, (cache.n_names + 1) * sizeof(char*));
+        cache.name_dirs = xrealloc(cache.name_dirs, (cache.n_names + 1) * sizeof(int));
+        cache.names[cache.n_names] = strdup(name);
+        cache.name_dirs[cache.n_names++] = found_dir;
+    }
+    // unknown names that changed nothing leave the file as it is
+    if (changed || cached >= 0 || found_dir >= 0) cache_save(&cache, cache_path, path_env);
+    cache_free(&cache);
+    free(cache_path);
+    return res;
+}
@@ -0,0 +1,17 @@
+#ifndef PATHCACHE_H
+#define PATHCACHE_H
+
+/* Resolution of executable names through $PATH.
+ *
+ * Resolved names are cached in `$XDG_CACHE_HOME/aperi/path.cache`, next to the
+ * applications index. The cache records the value of $PATH and the modification time of
+ * each of its directories: an entry is used only if PATH is unchanged and none of the
+ * directories up to the one containing the executable was modified since (a new
+ * executable in a previous directory would otherwise shadow it). */
+
+/* Return the absolute path of the executable `name`, searched in $PATH like execvp()
+ * does, or NULL if it can't be found. Names containing a `/` are returned as they are.
+ * The result must be freed. */
+char* path_lookup(const char* name);
+
+#endif
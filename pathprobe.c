@@ -0,0 +1,190 @@
+#define _GNU_SOURCE 1
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/sysmacros.h>
+#include "pathprobe.h"
+#include "util.h"
+
+// Deadline of the probe, in milliseconds, when $APERI_PROBE_TIMEOUT is not set
+#define DEFAULT_TIMEOUT_MS 2000
+
+// State shared by the caller and the helper thread. The last one to release it frees it.
+typedef struct Probe {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int refs;
+    int done;
+    char* path;
+    ProbeResult result;
+    struct stat st;
+    char* real_path;
+} Probe;
+
+/* Stat and resolve probe->path, filling the result members of `probe` */
+static void probe_run(Probe* probe);
+
+/* Helper thread body: run the probe and signal its completion */
+static void* probe_thread(void* arg);
+
+/* Drop a reference to `probe`, freeing it if it was the last one. probe->lock must be
+ * held and it's released. */
+static void probe_release(Probe* probe);
+
+/* Return the deadline of the probe in milliseconds, from $APERI_PROBE_TIMEOUT */
+static long probe_timeout_ms();
+
+static void probe_run(Probe* probe) {
+    struct statx stx;
+    if (statx(AT_FDCWD, probe->path, AT_STATX_DONT_SYNC, STATX_BASIC_STATS, &stx) != 0) {
+        probe->result = ProbeMissing;
+        return;
+    }
+    struct stat* st = &probe->st;
+    memset(st, 0, sizeof(struct stat));
+    st->st_dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+    st->st_ino = stx.stx_ino;
+    st->st_mode = stx.stx_mode;
+    st->st_nlink = stx.stx_nlink;
+    st->st_uid = stx.stx_uid;
+    st->st_gid = stx.stx_gid;
+    st->st_rdev = makedev(stx.stx_rdev_major, stx.stx_rdev_minor);
+    st->st_size = stx.stx_size;
+    st->st_blksize = stx.stx_blksize;
+    st->st_blocks = stx.stx_blocks;
+    st->st_atim.tv_sec = stx.stx_atime.tv_sec;
+    st->st_atim.tv_nsec = stx.stx_atime.tv_nsec;
+    st->st_mtim.tv_sec = stx.stx_mtime.tv_sec;
+    st->st_mtim.tv_nsec = stx.stx_mtime.tv_nsec;
+    st->st_ctim.tv_sec = stx.stx_ctime.tv_sec;
+    st->st_ctim.tv_nsec = stx.stx_ctime.tv_nsec;
+    probe->real_path = realpath(probe->path, NULL);
+    probe->result = ProbeOk;
+}
+
+static void* probe_thread(void* arg) {
+    Probe* probe = arg;
+    probe_run(probe);
+    pthread_mutex_lock(&probe->lock);
+    probe->done = 1;
+    pthread_cond_signal(&probe->cond);
+    probe_release(probe);
+    return NULL;
+}
+
+static void probe_release(Probe* probe) {
+    int last = --probe->refs == 0;
+    pthread_mutex_unlock(&probe->lock);
+    if (!last) return;
+    pthread_mutex_destroy(&probe->lock);
+    pthread_cond_destroy(&probe->cond);
+    free(probe->path);
+    free(probe->real_path);
+    free(probe);
+}
+
+static long probe_timeout_ms() {
+    const char* env = getenv("APERI_PROBE_TIMEOUT");
+    if (!env || !*env) return DEFAULT_TIMEOUT_MS;
+    char* end;
+    long res = strtol(env, &end, 10);
+    return *end || res < 0 ? DEFAULT_TIMEOUT_MS : res;
+}
+
+ProbeResult path_probe(const char* path, struct stat* st, char** real_path) {
+    Probe* probe = xmalloc(sizeof(Probe));
+    memset(probe, 0, sizeof(Probe));
+    probe->path = strdup(path);
+    probe->refs = 1;
+    long timeout = probe_timeout_ms();
+
+    pthread_t thread;
+    int threaded = 0;
+    if (timeout > 0) {
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&probe->cond, &attr);
+        pthread_condattr_destroy(&attr);
+        pthread_mutex_init(&probe->lock, NULL);
+        probe->refs = 2;
+        threaded = pthread_create(&thread, NULL, probe_thread, probe) == 0;
+        if (threaded) {
+            pthread_detach(thread);
+        } else {
+            probe->refs = 1;
+        }
+    } else {
+        pthread_mutex_init(&probe->lock, NULL);
+        pthread_cond_init(&probe->cond, NULL);
+    }
+    // no deadline (or no thread): probe synchronously
+    if (!threaded) {
+        probe_run(probe);
+        probe->done = 1;
+    }
+
+    pthread_mutex_lock(&probe->lock);
+    if (!probe->done) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += timeout / 1000;
+        deadline.tv_nsec += (timeout % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            ++deadline.tv_sec;
+            deadline.tv_nsec -= 1000000000;
+        }
+        while (!probe->done) {
+            if (pthread_cond_timedwait(&probe->cond, &probe->lock, &deadline) == ETIMEDOUT) {
+                break;
+            }
+        }
+    }
+    ProbeResult res = ProbeTimeout;
+    if (probe->done) {
+        res = probe->result;
+        if (res == ProbeOk) {
+            *st = probe->st;
+            *real_path = probe->real_path;
+            probe->real_path = NULL;
+        }
+    }
+    probe_release(probe);
+    return res;
+}
+
+char* lexical_path(const char* path) {
+    char cwd[PATH_MAX];
+    const char* base = "";
+    if (path[0] != '/') base = getcwd(cwd, sizeof(cwd)) ? cwd : "";
+    size_t base_ln = strlen(base);
+    char* res = xmalloc(base_ln + strlen(path) + 3);
+    // `res` is built one component at the time, without a trailing `/`
+    size_t ln = 0;
+    res[0] = 0;
+    for (int part = 0; part < 2; ++part) {
+        const char* c = part == 0 ? base : path;
+        while (*c) {
+            while (*c == '/') ++c;
+            const char* end = strchrnul(c, '/');
+            size_t comp_ln = end - c;
+            if (comp_ln == 2 && c[0] == '.' && c[1] == '.') {
+                while (ln > 0 && res[ln-1] != '/') --ln;
+                if (ln > 0) --ln;
+            } else if (comp_ln > 0 && !(comp_ln == 1 && c[0] == '.')) {
+                res[ln++] = '/';
+                memcpy(res + ln, c, comp_ln);
+                ln += comp_ln;
+            }
+            c = end;
+        }
+    }
+    if (ln == 0) res[ln++] = '/';
+    res[ln] = 0;
+    return res;
+}
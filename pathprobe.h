@@ -0,0 +1,28 @@
+#ifndef PATHPROBE_H
+#define PATHPROBE_H
+
+#include <sys/stat.h>
+
+/* Bounded-time probing of paths.
+ *
+ * A path on a stale network mount (NFS, sshfs...) can block stat() and realpath() for a
+ * long time, or forever. The probe runs them on a helper thread and waits for it at most
+ * `$APERI_PROBE_TIMEOUT` milliseconds (2000 by default; 0 waits without a deadline). The
+ * attributes are read with statx(AT_STATX_DONT_SYNC), which returns the cached ones
+ * instead of synchronizing them with a remote server. When the deadline expires the helper
+ * thread is abandoned: the filesystem waits of NFS and FUSE are killable, so it doesn't
+ * prevent the process from exec'ing the command. */
+
+typedef enum ProbeResult { ProbeOk, ProbeMissing, ProbeTimeout } ProbeResult;
+
+/* Stat `path` and resolve its real path. On ProbeOk `st` is set and `real_path` is set to
+ * the canonical absolute path of `path` (to be freed), or to NULL if it couldn't be
+ * resolved. ProbeMissing means that `path` doesn't exist (or can't be stat'ed) and
+ * ProbeTimeout that the probe didn't complete in time. */
+ProbeResult path_probe(const char* path, struct stat* st, char** real_path);
+
+/* Return the absolute path of `path` resolving `.` and `..` components lexically, without
+ * accessing the filesystem (symbolic links are not resolved). The result must be freed. */
+char* lexical_path(const char* path);
+
+#endif
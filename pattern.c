@@ -0,0 +1,571 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pattern.h"
+#include "util.h"
+
+// States of the nondeterministic automaton
+typedef enum NKind { NChar, NSplit, NEps, NMatch } NKind;
+
+typedef struct NState {
+    NKind kind;
+    // next states (-1 if none). NSplit uses both, NChar and NEps only `out`
+    int out;
+    int out1;
+    // id of the matched rule, for NMatch states
+    int rule;
+    // set of accepted bytes, for NChar states
+    uint32_t set[8];
+} NState;
+
+// A piece of automaton with a single entry and a single (NEps) exit still to connect
+typedef struct Frag {
+    int start;
+    int end;
+} Frag;
+
+// States of the deterministic automaton: sets of NChar states plus the lowest matched rule
+typedef struct DState {
+    int* states;
+    int n;
+    int rule;
+    // transitions, -1 if not computed yet
+    int next[256];
+} DState;
+
+struct PatternSet {
+    NState* nstates;
+    int n_nstates;
+    int allocated_nstates;
+    // entry state of each rule
+    int* starts;
+    int n_starts;
+    // lazily built deterministic automaton, reset when rules are added
+    DState** dstates;
+    int n_dstates;
+    int allocated_dstates;
+    // open addressing hash table of dstates indexes (-1 empty)
+    int* table;
+    int table_size;
+    // scratch space for closures
+    int* stack;
+    int* mark;
+    int generation;
+};
+
+// Regex parser state
+typedef struct Parser {
+    PatternSet* set;
+    const char* p;
+    int error;
+} Parser;
+
+/* Add a new nondeterministic state and return its index */
+static int nstate_new(PatternSet* set, NKind kind, int out, int out1);
+
+/* Fragments constructors */
+static Frag frag_set(PatternSet* set, const uint32_t* bytes);
+static Frag frag_any(PatternSet* set);
+static Frag frag_empty(PatternSet* set);
+static Frag frag_cat(PatternSet* set, Frag a, Frag b);
+static Frag frag_alt(PatternSet* set, Frag a, Frag b);
+
+/* Recursive descent parser: alternation, concatenation, repetition and atoms */
+static Frag parse_alt(Parser* ps);
+static Frag parse_cat(Parser* ps);
+static Frag parse_repeat(Parser* ps);
+static Frag parse_atom(Parser* ps);
+
+/* Parse a `[...]` class body (after the `[`) into `bytes` */
+static void parse_class(Parser* ps, uint32_t* bytes);
+
+/* Add the rule `regex` with explicit anchoring. Return 0 on success. */
+static int add_rule(PatternSet* set, const char* regex, int anchor_start, int anchor_end,
+                    int rule);
+
+/* Drop the deterministic automaton built so far */
+static void dfa_reset(PatternSet* set);
+
+/* Return the index of the deterministic state for the closure of `states` */
+static int dfa_state(PatternSet* set, const int* states, int n);
+
+// Byte sets helpers
+
+static void bytes_add(uint32_t* bytes, unsigned char c) {
+    bytes[c >> 5] |= 1u << (c & 31);
+}
+
+static int bytes_has(const uint32_t* bytes, unsigned char c) {
+    return (bytes[c >> 5] >> (c & 31)) & 1;
+}
+
+static void bytes_add_range(uint32_t* bytes, unsigned char from, unsigned char to) {
+    for (int c = from; c <= to; ++c) bytes_add(bytes, c);
+}
+
+static void bytes_negate(uint32_t* bytes) {
+    for (int i = 0; i < 8; ++i) bytes[i] = ~bytes[i];
+}
+
+/* Add the bytes of the `\<c>` shorthand class to `bytes`. Return 0 if `c` is not one. */
+static int bytes_add_shorthand(uint32_t* bytes, char c) {
+    uint32_t class[8] = {0};
+    switch (c) {
+        case 'd': case 'D':
+            bytes_add_range(class, '0', '9');
+            break;
+        case 'w': case 'W':
+            bytes_add_range(class, '0', '9');
+            bytes_add_range(class, 'a', 'z');
+            bytes_add_range(class, 'A', 'Z');
+            bytes_add(class, '_');
+            break;
+        case 's': case 'S':
+            bytes_add(class, ' ');
+            bytes_add_range(class, '\t', '\r');
+            break;
+        default:
+            return 0;
+    }
+    if (c >= 'A' && c <= 'Z') bytes_negate(class);
+    for (int i = 0; i < 8; ++i) bytes[i] |= class[i];
+    return 1;
+}
+
+/* Return the byte for the escape `\<c>` */
+static unsigned char escaped(char c) {
+    switch (c) {
+        case 'n': return '\n';
+        case 't': return '\t';
+        case 'r': return '\r';
+        default: return c;
+    }
+}
+
+// Automaton construction
+
+static int nstate_new(PatternSet* set, NKind kind, int out, int out1) {
+    if (set->n_nstates == set->allocated_nstates) {
+        set->allocated_nstates = set->allocated_nstates ? set->allocated_nstates * 2 : 64;
+        set->nstates = xrealloc(set->nstates, set->allocated_nstates * sizeof(NState));
+    }
+    NState* s = &set->nstates[set->n_nstates];
+    memset(s, 0, sizeof(NState));
+    s->kind = kind;
+    s->out = out;
+    s->out1 = out1;
+    s->rule = -1;
+    return set->n_nstates++;
+}
+
+static Frag frag_set(PatternSet* set, const uint32_t* bytes) {
+    int end = nstate_new(set, NEps, -1, -1);
+    int start = nstate_new(set, NChar, end, -1);
+    memcpy(set->nstates[start].set, bytes, sizeof(set->nstates[start].set));
+    return (Frag){start, end};
+}
+
+static Frag frag_any(PatternSet* set) {
+    uint32_t bytes[8];
+    memset(bytes, 0xff, sizeof(bytes));
+    return frag_set(set, bytes);
+}
+
+static Frag frag_empty(PatternSet* set) {
+    int s = nstate_new(set, NEps, -1, -1);
+    return (Frag){s, s};
+}
+
+static Frag frag_cat(PatternSet* set, Frag a, Frag b) {
+    set->nstates[a.end].out = b.start;
+    return (Frag){a.start, b.end};
+}
+
+static Frag frag_alt(PatternSet* set, Frag a, Frag b) {
+    int end = nstate_new(set, NEps, -1, -1);
+    int start = nstate_new(set, NSplit, a.start, b.start);
+    set->nstates[a.end].out = end;
+    set->nstates[b.end].out = end;
+    return (Frag){start, end};
+}
+
+/* `a*` */
+static Frag frag_star(PatternSet* set, Frag a) {
+    int end = nstate_new(set, NEps, -1, -1);
+    int start = nstate_new(set, NSplit, a.start, end);
+    set->nstates[a.end].out = start;
+    return (Frag){start, end};
+}
+
+/* `a+` */
+static Frag frag_plus(PatternSet* set, Frag a) {
+    int end = nstate_new(set, NEps, -1, -1);
+    int loop = nstate_new(set, NSplit, a.start, end);
+    set->nstates[a.end].out = loop;
+    return (Frag){a.start, end};
+}
+
+/* `a?` */
+static Frag frag_quest(PatternSet* set, Frag a) {
+    int end = nstate_new(set, NEps, -1, -1);
+    int start = nstate_new(set, NSplit, a.start, end);
+    set->nstates[a.end].out = end;
+    return (Frag){start, end};
+}
+
+static Frag parse_alt(Parser* ps) {
+    Frag f = parse_cat(ps);
+    while (*ps->p == '|') {
+        ++ps->p;
+        f = frag_alt(ps->set, f, parse_cat(ps));
+    }
+    return f;
+}
+
+static Frag parse_cat(Parser* ps) {
+    Frag f = frag_empty(ps->set);
+    while (*ps->p && *ps->p != '|' && *ps->p != ')') {
+        f = frag_cat(ps->set, f, parse_repeat(ps));
+    }
+    return f;
+}
+
+static Frag parse_repeat(Parser* ps) {
+    Frag f = parse_atom(ps);
+    while (1) {
+        if (*ps->p == '*') {
+            f = frag_star(ps->set, f);
+        } else if (*ps->p == '+') {
+            f = frag_plus(ps->set, f);
+        } else if (*ps->p == '?') {
+            f = frag_quest(ps->set, f);
+        } else {
+            return f;
+        }
+        ++ps->p;
+    }
+}
+
+static Frag parse_atom(Parser* ps) {
+    uint32_t bytes[8] = {0};
+    char c = *ps->p++;
+    switch (c) {
+        case '(':
+            {
+                Frag f = parse_alt(ps);
+                if (*ps->p != ')') {
+                    ps->error = 1;
+                } else {
+                    ++ps->p;
+                }
+                return f;
+            }
+        case '[':
+            parse_class(ps, bytes);
+            return frag_set(ps->set, bytes);
+        case '.':
+            return frag_any(ps->set);
+        case '*':
+        case '+':
+        case '?':
+            // nothing to repeat
+            ps->error = 1;
+            return frag_empty(ps->set);
+        case '\\':
+            c = *ps->p;
+            if (!c) {
+                ps->error = 1;
+                return frag_empty(ps->set);
+            }
+            ++ps->p;
+            if (!bytes_add_shorthand(bytes, c)) bytes_add(bytes, escaped(c));
+            return frag_set(ps->set, bytes);
+        default:
+            bytes_add(bytes, c);
+            return frag_set(ps->set, bytes);
+    }
+}
+
+static void parse_class(Parser* ps, uint32_t* bytes) {
+    int negate = *ps->p == '^';
+    if (negate) ++ps->p;
+    int first = 1;
+    while (*ps->p && (*ps->p != ']' || first)) {
+        unsigned char from = *ps->p++;
+        first = 0;
+        if (from == '\\' && *ps->p) {
+            if (bytes_add_shorthand(bytes, *ps->p)) {
+                ++ps->p;
+                continue;
+            }
+            from = escaped(*ps->p++);
+        }
+        if (ps->p[0] == '-' && ps->p[1] && ps->p[1] != ']') {
+            unsigned char to = ps->p[1];
+            ps->p += 2;
+            if (to == '\\' && *ps->p) to = escaped(*ps->p++);
+            if (to < from) {
+                ps->error = 1;
+                return;
+            }
+            bytes_add_range(bytes, from, to);
+        } else {
+            bytes_add(bytes, from);
+        }
+    }
+    if (*ps->p != ']') {
+        ps->error = 1;
+        return;
+    }
+    ++ps->p;
+    if (negate) bytes_negate(bytes);
+}
+
+static int add_rule(PatternSet* set, const char* regex, int anchor_start, int anchor_end,
+                    int rule) {
+    int n_nstates = set->n_nstates;
+    Parser ps = {set, regex, 0};
+    Frag f = parse_alt(&ps);
+    if (ps.error || *ps.p) {
+        // drop the states of the invalid rule
+        set->n_nstates = n_nstates;
+        return -1;
+    }
+    // unanchored regexes can start anywhere and end anywhere: surround them with `.*`
+    if (!anchor_start) f = frag_cat(set, frag_star(set, frag_any(set)), f);
+    if (!anchor_end) f = frag_cat(set, f, frag_star(set, frag_any(set)));
+    int match = nstate_new(set, NMatch, -1, -1);
+    set->nstates[match].rule = rule;
+    set->nstates[f.end].out = match;
+
+    set->starts = xrealloc(set->starts, (set->n_starts + 1) * sizeof(int));
+    set->starts[set->n_starts++] = f.start;
+    dfa_reset(set);
+    // the closure scratch space must cover the new states
+    free(set->mark);
+    free(set->stack);
+    set->mark = NULL;
+    set->stack = NULL;
+    return 0;
+}
+
+PatternSet* pattern_set_new() {
+    PatternSet* set = xmalloc(sizeof(PatternSet));
+    memset(set, 0, sizeof(PatternSet));
+    return set;
+}
+
+void pattern_set_free(PatternSet* set) {
+    if (!set) return;
+    dfa_reset(set);
+    free(set->dstates);
+    free(set->table);
+    free(set->nstates);
+    free(set->starts);
+    free(set->stack);
+    free(set->mark);
+    free(set);
+}
+
+int pattern_set_add_regex(PatternSet* set, const char* regex, int rule) {
+    int anchor_start = regex[0] == '^';
+    if (anchor_start) ++regex;
+    size_t ln = strlen(regex);
+    // a trailing `$` is an anchor unless it's escaped by an odd number of backslashes
+    size_t backslashes = 0;
+    while (ln >= backslashes + 2 && regex[ln - 2 - backslashes] == '\\') ++backslashes;
+    int anchor_end = ln > 0 && regex[ln-1] == '$' && backslashes % 2 == 0;
+    char* body = strndup(regex, anchor_end ? ln - 1 : ln);
+    int res = add_rule(set, body, anchor_start, anchor_end, rule);
+    free(body);
+    return res;
+}
+
+int pattern_set_add_glob(PatternSet* set, const char* glob, int rule) {
+    size_t ln = strlen(glob);
+    // worst case every character becomes `[^/]*` plus the `(.*/)?` prefix
+    char* regex = xmalloc(ln * 5 + 8);
+    char* d = regex;
+    int uri = strstr(glob, "://") != NULL;
+    if (glob[0] != '/' && !uri) d = stpcpy(d, "(.*/)?");
+    for (const char* c = glob; *c; ++c) {
+        switch (*c) {
+            case '*':
+                if (c[1] == '*') {
+                    d = stpcpy(d, ".*");
+                    while (c[1] == '*') ++c;
+                } else {
+                    d = stpcpy(d, "[^/]*");
+                }
+                break;
+            case '?':
+                d = stpcpy(d, "[^/]");
+                break;
+            case '[':
+                {
+                    // a trailing `[` is a literal
+                    const char* close = c[1] ? strchr(c + 2, ']') : NULL;
+                    if (!close) {
+                        d = stpcpy(d, "\\[");
+                        break;
+                    }
+                    *d++ = '[';
+                    ++c;
+                    if (*c == '!') {
+                        *d++ = '^';
+                        ++c;
+                    }
+                    while (c < close) *d++ = *c++;
+                    *d++ = ']';
+                }
+                break;
+            case '\\':
+                if (c[1]) ++c;
+                // fall through
+            default:
+                if (strchr(".+()|^$\\[]{}", *c)) *d++ = '\\';
+                *d++ = *c;
+                break;
+        }
+    }
+    *d = 0;
+    int res = add_rule(set, regex, 1, !uri, rule);
+    free(regex);
+    return res;
+}
+
+// Deterministic automaton
+
+static void dfa_reset(PatternSet* set) {
+    for (int i = 0; i < set->n_dstates; ++i) {
+        free(set->dstates[i]->states);
+        free(set->dstates[i]);
+    }
+    set->n_dstates = 0;
+    if (set->table) {
+        for (int i = 0; i < set->table_size; ++i) set->table[i] = -1;
+    }
+}
+
+static int int_cmp(const void* a, const void* b) {
+    return *(const int*)a - *(const int*)b;
+}
+
+static uint32_t dstate_hash(const int* states, int n, int rule) {
+    // FNV-1a
+    uint32_t h = 2166136261u ^ (uint32_t)rule;
+    for (int i = 0; i < n; ++i) {
+        h ^= (uint32_t)states[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void table_insert(PatternSet* set, uint32_t h, int idx) {
+    int mask = set->table_size - 1;
+    int i = h & mask;
+    while (set->table[i] >= 0) i = (i + 1) & mask;
+    set->table[i] = idx;
+}
+
+static int dfa_state(PatternSet* set, const int* seeds, int n_seeds) {
+    // epsilon closure of the seeds, keeping only the states consuming input
+    if (!set->mark) {
+        set->mark = xmalloc(set->n_nstates * sizeof(int));
+        // every visited state pushes at most two successors
+        set->stack = xmalloc((set->n_nstates * 3 + 1) * sizeof(int));
+        memset(set->mark, 0, set->n_nstates * sizeof(int));
+        set->generation = 0;
+    }
+    ++set->generation;
+    int* states = xmalloc((set->n_nstates + 1) * sizeof(int));
+    int n = 0;
+    int rule = -1;
+    int sp = 0;
+    for (int i = 0; i < n_seeds; ++i) set->stack[sp++] = seeds[i];
+    while (sp > 0) {
+        int s = set->stack[--sp];
+        if (s < 0 || set->mark[s] == set->generation) continue;
+        set->mark[s] = set->generation;
+        NState* ns = &set->nstates[s];
+        switch (ns->kind) {
+            case NChar:
+                states[n++] = s;
+                break;
+            case NMatch:
+                if (rule < 0 || ns->rule < rule) rule = ns->rule;
+                break;
+            case NSplit:
+                set->stack[sp++] = ns->out1;
+                // fall through
+            case NEps:
+                set->stack[sp++] = ns->out;
+                break;
+        }
+    }
+    qsort(states, n, sizeof(int), int_cmp);
+
+    uint32_t h = dstate_hash(states, n, rule);
+    if (set->table) {
+        int mask = set->table_size - 1;
+        for (int i = h & mask; set->table[i] >= 0; i = (i + 1) & mask) {
+            DState* d = set->dstates[set->table[i]];
+            if (d->n == n && d->rule == rule &&
+                memcmp(d->states, states, n * sizeof(int)) == 0) {
+                free(states);
+                return set->table[i];
+            }
+        }
+    }
+
+    DState* d = xmalloc(sizeof(DState));
+    d->states = states;
+    d->n = n;
+    d->rule = rule;
+    for (int i = 0; i < 256; ++i) d->next[i] = -1;
+    if (set->n_dstates == set->allocated_dstates) {
+        set->allocated_dstates = set->allocated_dstates ? set->allocated_dstates * 2 : 16;
+        set->dstates = xrealloc(set->dstates, set->allocated_dstates * sizeof(DState*));
+    }
+    set->dstates[set->n_dstates] = d;
+    // keep the hash table at most half full
+    if (set->n_dstates * 2 >= set->table_size) {
+        free(set->table);
+        set->table_size = set->table_size ? set->table_size * 2 : 32;
+        set->table = xmalloc(set->table_size * sizeof(int));
+        for (int i = 0; i < set->table_size; ++i) set->table[i] = -1;
+        for (int i = 0; i < set->n_dstates; ++i) {
+            DState* o = set->dstates[i];
+            table_insert(set, dstate_hash(o->states, o->n, o->rule), i);
+        }
+    }
+    table_insert(set, h, set->n_dstates);
+    return set->n_dstates++;
+}
+
+int pattern_set_match(PatternSet* set, const char* s) {
+    if (set->n_starts == 0) return -1;
+    int current = dfa_state(set, set->starts, set->n_starts);
+    int* seeds = xmalloc(set->n_nstates * sizeof(int));
+    for (const unsigned char* c = (const unsigned char*)s; *c; ++c) {
+        DState* d = set->dstates[current];
+        if (d->n == 0) {
+            // dead state: nothing can match the rest of the string
+            free(seeds);
+            return -1;
+        }
+        if (d->next[*c] < 0) {
+            int n_seeds = 0;
+            for (int i = 0; i < d->n; ++i) {
+                NState* ns = &set->nstates[d->states[i]];
+                if (bytes_has(ns->set, *c)) seeds[n_seeds++] = ns->out;
+            }
+            int next = dfa_state(set, seeds, n_seeds);
+            // dfa_state may have moved the dstates array
+            set->dstates[current]->next[*c] = next;
+        }
+        current = set->dstates[current]->next[*c];
+    }
+    free(seeds);
+    return set->dstates[current]->rule;
+}
@@ -0,0 +1,32 @@
+#ifndef PATTERN_H
+#define PATTERN_H
+
+/* A set of glob and regex rules compiled together in a single automaton. Every rule is
+ * translated to a piece of a nondeterministic automaton tagged with the rule id; the
+ * deterministic automaton is built lazily while scanning the argument, so matching is a
+ * single linear scan whatever the number of rules. */
+typedef struct PatternSet PatternSet;
+
+/* Allocate an empty pattern set */
+PatternSet* pattern_set_new();
+
+/* Free the pattern set and all the associated resources */
+void pattern_set_free(PatternSet* set);
+
+/* Add a glob rule with id `rule`. `*` matches any sequence of characters except `/`,
+ * `**` any sequence of characters, `?` a single character except `/` and `[...]` a
+ * character class (`[!...]` negated). Globs starting with `/` must match the whole path,
+ * globs containing `://` match the URIs starting with them and all the other globs must
+ * match the last components of the path. Return 0 on success, -1 if the glob is invalid. */
+int pattern_set_add_glob(PatternSet* set, const char* glob, int rule);
+
+/* Add an extended regular expression with id `rule`. The regex can match anywhere in the
+ * argument unless it starts with `^` and/or ends with `$`. Supported syntax: `.`, `[...]`,
+ * `[^...]`, `*`, `+`, `?`, `|`, `(...)` and the `\d`, `\w`, `\s` classes (and their
+ * uppercase negations). Return 0 on success, -1 if the regex is invalid. */
+int pattern_set_add_regex(PatternSet* set, const char* regex, int rule);
+
+/* Return the lowest id among the rules matching `s`, or -1 if none matches */
+int pattern_set_match(PatternSet* set, const char* s);
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+#include "config.h"
+
+/* USDT static probes, enabled by the `usdt` build option.
+ *
+ * Probes mark the phase boundaries of aperi, aperi_fm1 and wipewine and can be traced,
+ * for example, with `bpftrace -l 'usdt:/usr/bin/aperi:*'`. An enabled probe compiles to a
+ * single nop instruction until a tracer attaches to it; without the option the macros
+ * expand to nothing. Probes defined:
+ *
+ *  aperi:config_open(const char* path, int opened)
+ *  aperi:rule_match(int rule_index, long command_offset)
+ *  aperi:wrapper_hit(const char* wrapper_path)
+ *  aperi:exec(const char* executable, const char* argv0)
+ *  aperi_fm1:request_received(unsigned serial)
+ *  aperi_fm1:child_spawned(int aperi_pid, const char* arg)
+ *  aperi_fm1:child_reaped(int fork_pid, int status)
+ *  wipewine:event_received(const char* name, unsigned mask)
+ *  wipewine:file_unlinked(const char* name)
+ *
+ * aperi_fm1 runs aperi from an intermediate process, that exits at once so that aperi isn't
+ * its child: child_spawned reports the pid of aperi (-1 if unknown), child_reaped the pid
+ * and the wait status of the intermediate process.
+ *
+ * The arguments of a probe are evaluated even without a tracer: the probes passing a
+ * computed value are guarded by PROBE_ENABLED(provider, name), true only while a tracer is
+ * attached. It reads the semaphore of the probe, incremented by the tracers, which every
+ * file using probes defines, for each of them, with PROBE_SEMAPHORE(provider, name). */
+
+#ifdef HAVE_USDT
+// the probes record the address of their semaphore
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+#define PROBE1(provider, name, a1) DTRACE_PROBE1(provider, name, a1)
+#define PROBE2(provider, name, a1, a2) DTRACE_PROBE2(provider, name, a1, a2)
+#define PROBE_SEMAPHORE(provider, name) \
+    volatile unsigned short provider##_##name##_semaphore \
+            __attribute__((unused, section(".probes")))
+#define PROBE_ENABLED(provider, name) __builtin_expect(provider##_##name##_semaphore != 0, 0)
+#else
+#define PROBE1(provider, name, a1) do {} while (0)
+#define PROBE2(provider, name, a1, a2) do {} while (0)
+#define PROBE_SEMAPHORE(provider, name) extern int provider##_##name##_semaphore
+#define PROBE_ENABLED(provider, name) 0
+#endif
+
+#endif
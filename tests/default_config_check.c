@@ -0,0 +1,49 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "compiled_config.h"
+// DEFAULT_CONFIG: the test config compiled by aperi_compile -c
+#include "test_default_config.h"
+
+/* Test of the config forms written by aperi_compile.
+ *
+ * Checks that the rules embedded as DEFAULT_CONFIG (the C header form, that aperi reads
+ * with fmemopen) are byte for byte the ones of the compiled config file of the same
+ * config, after its COMPILED_CONFIG_MAGIC line.
+ *
+ * Usage: default_config_check <compiled config> */
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <compiled config>\n", argv[0]);
+        return 2;
+    }
+    FILE* f = fopen(argv[1], "rb");
+    if (!f) {
+        perror(argv[1]);
+        return 1;
+    }
+    size_t magic_ln = strlen(COMPILED_CONFIG_MAGIC);
+    size_t rules_ln = sizeof(DEFAULT_CONFIG) - 1;
+    char* content = malloc(magic_ln + rules_ln + 1);
+    if (!content) {
+        fclose(f);
+        return 1;
+    }
+    // one byte more than expected, to detect longer files
+    size_t ln = fread(content, 1, magic_ln + rules_ln + 1, f);
+    fclose(f);
+    int res = 0;
+    if (ln < magic_ln || memcmp(content, COMPILED_CONFIG_MAGIC, magic_ln) != 0) {
+        fprintf(stderr, "%s: not a compiled config\n", argv[1]);
+        res = 1;
+    } else if (ln - magic_ln != rules_ln ||
+               memcmp(content + magic_ln, DEFAULT_CONFIG, rules_ln) != 0) {
+        fprintf(stderr, "%s: rules differing from DEFAULT_CONFIG\n", argv[1]);
+        res = 1;
+    } else {
+        printf("ok: %zu bytes of rules\n", rules_ln);
+    }
+    free(content);
+    return res;
+}
@@ -0,0 +1,155 @@
+#define _GNU_SOURCE 1
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <dbus/dbus.h>
+#include "private_bus.h"
+
+/* Startup benchmark for aperi_fm1 builds.
+ *
+ * On a private session bus, starts every aperi_fm1 executable given on the command line
+ * `-n` times and measures the time from the spawn to the NameOwnerChanged signal for
+ * org.freedesktop.FileManager1, then the resident memory of the ready process. Used to
+ * compare the native D-Bus client (`-Ddbus=native`) with the libdbus build.
+ *
+ * Usage: fm1_startup [-n runs] [-d dbus-daemon] <aperi_fm1>... */
+
+extern char** environ;
+
+#define FM1_NAME "org.freedesktop.FileManager1"
+
+/* Return the CLOCK_MONOTONIC time in ns */
+static long long now_ns();
+
+/* Wait for the NameOwnerChanged signal of FM1_NAME. If `acquired` wait for a new owner,
+ * else for the name to be released. Return 0 on success, 1 on timeout. */
+static int wait_owner_changed(DBusConnection* connection, int acquired);
+
+/* Return the VmRSS of `pid` in kB, or -1 */
+static long rss_kb(pid_t pid);
+
+/* Run `fm1` `runs` times and print its statistics. Return 0 on success */
+static int bench(DBusConnection* connection, const char* fm1, int runs);
+
+static long long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int wait_owner_changed(DBusConnection* connection, int acquired) {
+    long long deadline = now_ns() + 5000000000LL;
+    while (now_ns() < deadline) {
+        dbus_connection_read_write(connection, 100);
+        DBusMessage* msg;
+        while ((msg = dbus_connection_pop_message(connection))) {
+            const char *name, *old_owner, *new_owner;
+            int done = dbus_message_is_signal(msg, DBUS_INTERFACE_DBUS, "NameOwnerChanged") &&
+                       dbus_message_get_args(msg, NULL, DBUS_TYPE_STRING, &name,
+                                             DBUS_TYPE_STRING, &old_owner,
+                                             DBUS_TYPE_STRING, &new_owner,
+                                             DBUS_TYPE_INVALID) &&
+                       strcmp(name, FM1_NAME) == 0 && (*new_owner != 0) == acquired;
+            dbus_message_unref(msg);
+            if (done) return 0;
+        }
+    }
+    return 1;
+}
+
+static long rss_kb(pid_t pid) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+    FILE* f = fopen(path, "r");
+    if (!f) return -1;
+    char line[256];
+    long res = -1;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "VmRSS: %ld", &res) == 1) break;
+    }
+    fclose(f);
+    return res;
+}
+
+static int cmp_ll(const void* a, const void* b) {
+    long long x = *(const long long*)a;
+    long long y = *(const long long*)b;
+    return x < y ? -1 : x > y;
+}
+
+static int bench(DBusConnection* connection, const char* fm1, int runs) {
+    long long* startup = malloc(runs * sizeof(long long));
+    long long* rss = malloc(runs * sizeof(long long));
+    int res = 0;
+    for (int i = 0; i < runs && !res; ++i) {
+        char* argv[] = {(char*)fm1, NULL};
+        pid_t pid;
+        long long start = now_ns();
+        if (posix_spawn(&pid, fm1, NULL, NULL, argv, environ) != 0) {
+            fprintf(stderr, "Couldn't start %s\n", fm1);
+            res = 1;
+            break;
+        }
+        if (wait_owner_changed(connection, 1)) {
+            fprintf(stderr, "%s didn't acquire %s\n", fm1, FM1_NAME);
+            res = 1;
+        }
+        startup[i] = now_ns() - start;
+        rss[i] = rss_kb(pid);
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+        if (!res) res = wait_owner_changed(connection, 0);
+    }
+    if (!res) {
+        qsort(startup, runs, sizeof(long long), cmp_ll);
+        qsort(rss, runs, sizeof(long long), cmp_ll);
+        printf("%-40s startup min %7.3f ms  median %7.3f ms  max %7.3f ms  RSS %6lld kB\n",
+               fm1, startup[0] / 1e6, startup[runs / 2] / 1e6, startup[runs - 1] / 1e6,
+               rss[runs / 2]);
+    }
+    free(startup);
+    free(rss);
+    return res;
+}
+
+int main(int argc, char* argv[]) {
+    int runs = 20;
+    const char* dbus_daemon = "dbus-daemon";
+    int opt;
+    while ((opt = getopt(argc, argv, "n:d:")) != -1) {
+        switch (opt) {
+            case 'n': runs = atoi(optarg); break;
+            case 'd': dbus_daemon = optarg; break;
+            default: optind = argc + 1;
+        }
+    }
+    if (optind >= argc || runs <= 0) {
+        fprintf(stderr, "Usage: %s [-n runs] [-d dbus-daemon] <aperi_fm1>...\n", argv[0]);
+        return 2;
+    }
+    pid_t bus_pid = private_bus_start(dbus_daemon);
+    if (bus_pid < 0) return 1;
+    DBusError error;
+    dbus_error_init(&error);
+    DBusConnection* connection = dbus_connection_open_private(
+            getenv("DBUS_SESSION_BUS_ADDRESS"), &error);
+    if (!connection || !dbus_bus_register(connection, &error)) {
+        fprintf(stderr, "Connection Error (%s)\n", error.message);
+        dbus_error_free(&error);
+        private_bus_stop(bus_pid);
+        return 1;
+    }
+    dbus_bus_add_match(connection, "type='signal',sender='" DBUS_SERVICE_DBUS "',"
+                       "member='NameOwnerChanged',arg0='" FM1_NAME "'", NULL);
+    int res = 0;
+    for (int i = optind; i < argc && !res; ++i) res = bench(connection, argv[i], runs);
+    dbus_connection_close(connection);
+    dbus_connection_unref(connection);
+    private_bus_stop(bus_pid);
+    return res;
+}
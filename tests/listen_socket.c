@@ -0,0 +1,41 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* Minimal server for the client rules of test.sh.
+ *
+ * Listens on the unix socket `socket` (`@<name>` for an abstract socket), accepting and
+ * closing the connections, and exits after `seconds`.
+ *
+ * Usage: listen_socket <socket> <seconds> */
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <socket> <seconds>\n", argv[0]);
+        return 2;
+    }
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    size_t ln = strlen(argv[1]);
+    if (ln == 0 || ln >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Invalid socket %s\n", argv[1]);
+        return 1;
+    }
+    memcpy(addr.sun_path, argv[1], ln);
+    if (argv[1][0] == '@') addr.sun_path[0] = 0;
+    socklen_t addr_ln = offsetof(struct sockaddr_un, sun_path) + ln;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr*)&addr, addr_ln) || listen(fd, 16)) {
+        perror(argv[1]);
+        return 1;
+    }
+    // the default action of SIGALRM ends the server
+    alarm(atoi(argv[2]));
+    while (1) {
+        int client = accept(fd, NULL, NULL);
+        if (client >= 0) close(client);
+    }
+}
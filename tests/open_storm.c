@@ -0,0 +1,407 @@
+#define _GNU_SOURCE 1
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <getopt.h>
+#include <limits.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <dbus/dbus.h>
+#include "private_bus.h"
+
+/* "Open storm" load generator for aperi and aperi_fm1.
+ *
+ * Starts a private session bus and aperi_fm1 on it, then fires bursts of ShowItems calls
+ * and direct aperi invocations. Both are handled by a temporary aperi config whose rules
+ * run this same program in stub mode (`--stub <log> <file>`), which appends the request
+ * id and a CLOCK_MONOTONIC timestamp to a log. At the end the latency of every request is
+ * computed from the log, and requests missing from it after the timeout are reported as
+ * dropped.
+ *
+ * Usage: open_storm [-b bursts] [-n requests per burst] [-i interval ms] [-t timeout ms]
+ *                   [-d dbus-daemon] <aperi> <aperi_fm1> */
+
+extern char** environ;
+
+#define FM1_NAME "org.freedesktop.FileManager1"
+#define FM1_PATH "/org/freedesktop/FileManager1"
+#define FM1_INTERFACE "org.freedesktop.FileManager1"
+
+// Kinds of request
+typedef enum RequestKind { RKShowItems, RKDirect } RequestKind;
+
+typedef struct Request {
+    RequestKind kind;
+    // send and completion (stub) times, in ns. done is 0 until completed
+    long long sent;
+    long long done;
+    // pending ShowItems call (NULL once the reply arrived)
+    DBusPendingCall* pending;
+    // the D-Bus call failed
+    int error;
+} Request;
+
+typedef struct Storm {
+    // private bus and aperi_fm1
+    pid_t bus_pid;
+    pid_t fm1_pid;
+    DBusConnection* connection;
+    // temporary directory and stub log
+    char* tmpdir;
+    char* log_path;
+    int log_fd;
+    // partial line read from the log
+    char log_line[64];
+    int log_line_ln;
+    Request* requests;
+    int n_requests;
+} Storm;
+
+/* Return the CLOCK_MONOTONIC time in ns */
+static long long now_ns();
+
+/* Stub handler: append "<id> <timestamp>" to `log_path`, where id is the number at the
+ * beginning of the last component of `arg` */
+static int stub(const char* log_path, const char* arg);
+
+/* Return `dir`/`name`. The result must be freed. */
+static char* join(const char* dir, const char* name);
+
+/* Write `content` to the new file `path`. Return 0 on success */
+static int write_file(const char* path, const char* content);
+
+/* Create the temporary directory with the aperi config and the files to open */
+static int storm_setup_dir(Storm* storm, int n_files);
+
+/* Start the private bus, connect to it and start aperi_fm1 */
+static int storm_start(Storm* storm, const char* dbus_daemon, const char* fm1);
+
+/* Send request `id` */
+static void storm_send(Storm* storm, int id, const char* aperi);
+
+/* Process replies, reap children and read the log for `ms` milliseconds or until all the
+ * requests are completed, if `until_done` */
+static void storm_pump(Storm* storm, long ms, int until_done);
+
+/* Print the statistics of the requests of kind `kind` (or all if kind < 0) */
+static void storm_report(Storm* storm, const char* title, int kind);
+
+/* Stop aperi_fm1 and the bus and remove the temporary directory */
+static void storm_stop(Storm* storm);
+
+static long long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int stub(const char* log_path, const char* arg) {
+    long long ts = now_ns();
+    const char* name = strrchr(arg, '/');
+    name = name ? name + 1 : arg;
+    char line[64];
+    int ln = snprintf(line, sizeof(line), "%ld %lld\n", strtol(name, NULL, 10), ts);
+    int fd = open(log_path, O_WRONLY | O_APPEND | O_CREAT, 0600);
+    // a single short write to an O_APPEND file is never interleaved with the others
+    if (fd < 0 || write(fd, line, ln) != ln) return 1;
+    close(fd);
+    return 0;
+}
+
+static char* join(const char* dir, const char* name) {
+    char* res = malloc(strlen(dir) + strlen(name) + 2);
+    stpcpy(stpcpy(stpcpy(res, dir), "/"), name);
+    return res;
+}
+
+static int write_file(const char* path, const char* content) {
+    FILE* f = fopen(path, "w");
+    if (!f) return 1;
+    fputs(content, f);
+    return fclose(f) != 0;
+}
+
+static int storm_setup_dir(Storm* storm, int n_files) {
+    char tmpl[] = "/tmp/aperi_storm.XXXXXX";
+    if (!mkdtemp(tmpl)) return 1;
+    storm->tmpdir = strdup(tmpl);
+    storm->log_path = join(storm->tmpdir, "log");
+    char* config_dir = join(storm->tmpdir, "aperi");
+    char* config_path = join(config_dir, "config");
+    char* cache_dir = join(storm->tmpdir, "cache");
+    char* files_dir = join(storm->tmpdir, "files");
+    char self[PATH_MAX];
+    ssize_t ln = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    int res = ln < 0 || mkdir(config_dir, 0700) || mkdir(cache_dir, 0700) ||
+              mkdir(files_dir, 0700) || write_file(storm->log_path, "");
+    if (!res) {
+        self[ln] = 0;
+        // aperi_fm1 passes aperi-show-items://<path> URIs, aperi is called with the files
+        char* config;
+        asprintf(&config, "aperi-show-items://=%%\"%s\" --stub \"%s\" %%f\n"
+                          "storm=\"%s\" --stub \"%s\"\n",
+                 self, storm->log_path, self, storm->log_path);
+        res = write_file(config_path, config);
+        free(config);
+    }
+    for (int i = 0; !res && i < n_files; ++i) {
+        char name[32];
+        snprintf(name, sizeof(name), "%d.storm", i);
+        char* path = join(files_dir, name);
+        res = write_file(path, "");
+        free(path);
+    }
+    setenv("XDG_CONFIG_HOME", storm->tmpdir, 1);
+    setenv("XDG_CACHE_HOME", cache_dir, 1);
+    storm->log_fd = res ? -1 : open(storm->log_path, O_RDONLY);
+    free(config_dir);
+    free(config_path);
+    free(cache_dir);
+    free(files_dir);
+    return res || storm->log_fd < 0;
+}
+
+static int storm_start(Storm* storm, const char* dbus_daemon, const char* fm1) {
+    storm->bus_pid = private_bus_start(dbus_daemon);
+    if (storm->bus_pid < 0) return 1;
+    const char* address = getenv("DBUS_SESSION_BUS_ADDRESS");
+
+    DBusError error;
+    dbus_error_init(&error);
+    storm->connection = dbus_connection_open_private(address, &error);
+    if (!storm->connection || !dbus_bus_register(storm->connection, &error)) {
+        fprintf(stderr, "Connection Error (%s)\n", error.message);
+        dbus_error_free(&error);
+        return 1;
+    }
+
+    char* fm1_argv[] = {(char*)fm1, NULL};
+    int res = posix_spawn(&storm->fm1_pid, fm1, NULL, NULL, fm1_argv, environ);
+    if (res) {
+        fprintf(stderr, "Couldn't start %s: %s\n", fm1, strerror(res));
+        return 1;
+    }
+    // wait for aperi_fm1 to own its name
+    for (int i = 0; i < 500; ++i) {
+        if (dbus_bus_name_has_owner(storm->connection, FM1_NAME, NULL)) return 0;
+        usleep(10000);
+    }
+    fprintf(stderr, "aperi_fm1 didn't acquire %s\n", FM1_NAME);
+    return 1;
+}
+
+static void storm_send(Storm* storm, int id, const char* aperi) {
+    Request* request = &storm->requests[id];
+    char* path;
+    asprintf(&path, "%s/files/%d.storm", storm->tmpdir, id);
+    request->sent = now_ns();
+    if (request->kind == RKShowItems) {
+        char* uri;
+        asprintf(&uri, "file://%s", path);
+        const char* startup_id = "";
+        DBusMessage* msg = dbus_message_new_method_call(FM1_NAME, FM1_PATH, FM1_INTERFACE,
+                                                        "ShowItems");
+        const char** uris = (const char**)&uri;
+        dbus_message_append_args(msg, DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, &uris, 1,
+                                 DBUS_TYPE_STRING, &startup_id, DBUS_TYPE_INVALID);
+        if (!dbus_connection_send_with_reply(storm->connection, msg, &request->pending,
+                                             DBUS_TIMEOUT_INFINITE) || !request->pending) {
+            request->error = 1;
+        }
+        dbus_message_unref(msg);
+        free(uri);
+    } else {
+        char* argv[] = {"aperi", path, NULL};
+        pid_t pid;
+        request->error = posix_spawn(&pid, aperi, NULL, NULL, argv, environ) != 0;
+    }
+    free(path);
+}
+
+static void storm_pump(Storm* storm, long ms, int until_done) {
+    long long deadline = now_ns() + ms * 1000000LL;
+    while (now_ns() < deadline) {
+        dbus_connection_read_write_dispatch(storm->connection, 5);
+        int completed = 1;
+        for (int i = 0; i < storm->n_requests; ++i) {
+            Request* request = &storm->requests[i];
+            if (request->pending && dbus_pending_call_get_completed(request->pending)) {
+                DBusMessage* reply = dbus_pending_call_steal_reply(request->pending);
+                if (!reply || dbus_message_get_type(reply) == DBUS_MESSAGE_TYPE_ERROR) {
+                    request->error = 1;
+                }
+                if (reply) dbus_message_unref(reply);
+                dbus_pending_call_unref(request->pending);
+                request->pending = NULL;
+            }
+            completed &= request->done > 0 || request->error;
+        }
+        // reap aperi and the stubs (reparented to us, the subreaper)
+        while (waitpid(-1, NULL, WNOHANG) > 0) {}
+        // read the new log lines
+        char buf[4096];
+        ssize_t ln;
+        while ((ln = read(storm->log_fd, buf, sizeof(buf))) > 0) {
+            for (ssize_t i = 0; i < ln; ++i) {
+                if (buf[i] != '\n') {
+                    if (storm->log_line_ln < (int)sizeof(storm->log_line) - 1) {
+                        storm->log_line[storm->log_line_ln++] = buf[i];
+                    }
+                    continue;
+                }
+                storm->log_line[storm->log_line_ln] = 0;
+                storm->log_line_ln = 0;
+                int id;
+                long long ts;
+                if (sscanf(storm->log_line, "%d %lld", &id, &ts) == 2 && id >= 0 &&
+                    id < storm->n_requests && !storm->requests[id].done) {
+                    storm->requests[id].done = ts;
+                }
+            }
+        }
+        if (until_done && completed) break;
+    }
+}
+
+static int cmp_ll(const void* a, const void* b) {
+    long long x = *(const long long*)a;
+    long long y = *(const long long*)b;
+    return x < y ? -1 : x > y;
+}
+
+static void storm_report(Storm* storm, const char* title, int kind) {
+    long long* latencies = malloc(storm->n_requests * sizeof(long long));
+    int n = 0;
+    int total = 0;
+    int errors = 0;
+    long long first_sent = 0;
+    long long last_done = 0;
+    for (int i = 0; i < storm->n_requests; ++i) {
+        Request* request = &storm->requests[i];
+        if (kind >= 0 && (int)request->kind != kind) continue;
+        ++total;
+        errors += request->error;
+        if (!first_sent || request->sent < first_sent) first_sent = request->sent;
+        if (!request->done) continue;
+        latencies[n++] = request->done - request->sent;
+        if (request->done > last_done) last_done = request->done;
+    }
+    qsort(latencies, n, sizeof(long long), cmp_ll);
+    double elapsed = (last_done - first_sent) / 1e9;
+    printf("%-10s requests %5d  completed %5d  dropped %5d  errors %5d", title, total, n,
+           total - n, errors);
+    if (n > 0) {
+        printf("  throughput %8.1f/s  p50 %8.3f ms  p99 %8.3f ms  max %8.3f ms",
+               elapsed > 0 ? n / elapsed : 0, latencies[n / 2] / 1e6,
+               latencies[(n * 99) / 100 < n ? (n * 99) / 100 : n - 1] / 1e6,
+               latencies[n - 1] / 1e6);
+    }
+    printf("\n");
+    free(latencies);
+}
+
+static int rm_entry(const char* path, const struct stat* sb, int flag, struct FTW* ftw) {
+    return remove(path);
+}
+
+static void storm_stop(Storm* storm) {
+    if (storm->connection) {
+        dbus_connection_close(storm->connection);
+        dbus_connection_unref(storm->connection);
+    }
+    if (storm->fm1_pid > 0) {
+        kill(storm->fm1_pid, SIGTERM);
+        waitpid(storm->fm1_pid, NULL, 0);
+    }
+    if (storm->bus_pid > 0) private_bus_stop(storm->bus_pid);
+    if (storm->log_fd >= 0) close(storm->log_fd);
+    if (storm->tmpdir) nftw(storm->tmpdir, rm_entry, 16, FTW_DEPTH | FTW_PHYS);
+    free(storm->tmpdir);
+    free(storm->log_path);
+    free(storm->requests);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc == 4 && strcmp(argv[1], "--stub") == 0) return stub(argv[2], argv[3]);
+
+    int bursts = 10;
+    int burst_size = 20;
+    long interval = 100;
+    long timeout = 10000;
+    const char* dbus_daemon = "dbus-daemon";
+    int opt;
+    while ((opt = getopt(argc, argv, "b:n:i:t:d:")) != -1) {
+        switch (opt) {
+            case 'b': bursts = atoi(optarg); break;
+            case 'n': burst_size = atoi(optarg); break;
+            case 'i': interval = atol(optarg); break;
+            case 't': timeout = atol(optarg); break;
+            case 'd': dbus_daemon = optarg; break;
+            default: optind = argc + 1;
+        }
+    }
+    if (optind != argc - 2 || bursts <= 0 || burst_size <= 0) {
+        fprintf(stderr, "Usage: %s [-b bursts] [-n requests per burst] [-i interval ms] "
+                "[-t timeout ms] [-d dbus-daemon] <aperi> <aperi_fm1>\n", argv[0]);
+        return 2;
+    }
+    char* aperi = realpath(argv[optind], NULL);
+    char* fm1 = realpath(argv[optind + 1], NULL);
+    if (!aperi || !fm1) {
+        fprintf(stderr, "aperi or aperi_fm1 not found\n");
+        return 2;
+    }
+    // aperi_fm1 runs `aperi` from the PATH: put the one under test first
+    char* aperi_dir = strdup(aperi);
+    *strrchr(aperi_dir, '/') = 0;
+    char* path_env;
+    asprintf(&path_env, "%s:%s", aperi_dir, getenv("PATH") ? getenv("PATH") : "/usr/bin");
+    setenv("PATH", path_env, 1);
+    // stubs started by aperi_fm1 are double forked: reap them here
+    prctl(PR_SET_CHILD_SUBREAPER, 1);
+    signal(SIGPIPE, SIG_IGN);
+
+    Storm storm;
+    memset(&storm, 0, sizeof(storm));
+    storm.log_fd = -1;
+    // each burst is split between ShowItems calls and direct aperi invocations
+    storm.n_requests = bursts * burst_size * 2;
+    storm.requests = calloc(storm.n_requests, sizeof(Request));
+    int res = 1;
+    if (storm_setup_dir(&storm, storm.n_requests) == 0 &&
+        storm_start(&storm, dbus_daemon, fm1) == 0) {
+        int id = 0;
+        for (int b = 0; b < bursts; ++b) {
+            for (int i = 0; i < burst_size; ++i) {
+                storm.requests[id].kind = RKShowItems;
+                storm_send(&storm, id++, aperi);
+                storm.requests[id].kind = RKDirect;
+                storm_send(&storm, id++, aperi);
+            }
+            dbus_connection_flush(storm.connection);
+            storm_pump(&storm, interval, 0);
+        }
+        storm_pump(&storm, timeout, 1);
+        printf("open storm: %d bursts of %d ShowItems calls and %d aperi invocations\n",
+               bursts, burst_size, burst_size);
+        storm_report(&storm, "ShowItems", RKShowItems);
+        storm_report(&storm, "aperi", RKDirect);
+        storm_report(&storm, "total", -1);
+        res = 0;
+        for (int i = 0; i < storm.n_requests; ++i) res |= !storm.requests[i].done;
+    }
+    storm_stop(&storm);
+    free(path_env);
+    free(aperi_dir);
+    free(aperi);
+    free(fm1);
+    return res;
+}
@@ -0,0 +1,184 @@
+#define _GNU_SOURCE 1
+#include <limits.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <dbus/dbus.h>
+#include "private_bus.h"
+
+/* Test of aperi_portal.
+ *
+ * On a private session bus, starts aperi_portal with the test config (it must run in the
+ * tests directory) and checks the applications it chooses for a desktop entry rule, a
+ * command rule and requests without matching choices.
+ *
+ * Usage: portal_choose [-d dbus-daemon] <aperi_portal> <aperi> */
+
+extern char** environ;
+
+#define PORTAL_NAME "org.freedesktop.impl.portal.desktop.aperi"
+#define PORTAL_PATH "/org/freedesktop/portal/desktop"
+#define PORTAL_INTERFACE "org.freedesktop.impl.portal.AppChooser"
+
+/* Wait until PORTAL_NAME has an owner. Return 0 on success, 1 on timeout */
+static int wait_portal(DBusConnection* connection);
+
+/* Call ChooseApplication for `uri` with the `n` `choices` and `last_choice` (if not NULL)
+ * and check that the response is `expected` (NULL: no choice). Return 0 on success */
+static int check_choice(DBusConnection* connection, const char* uri, const char** choices,
+                        int n, const char* last_choice, const char* expected);
+
+static int wait_portal(DBusConnection* connection) {
+    for (int i = 0; i < 500; ++i) {
+        if (dbus_bus_name_has_owner(connection, PORTAL_NAME, NULL)) return 0;
+        struct timespec ts = {0, 10000000};
+        nanosleep(&ts, NULL);
+    }
+    return 1;
+}
+
+static int check_choice(DBusConnection* connection, const char* uri, const char** choices,
+                        int n, const char* last_choice, const char* expected) {
+    DBusMessage* msg = dbus_message_new_method_call(PORTAL_NAME, PORTAL_PATH,
+                                                    PORTAL_INTERFACE, "ChooseApplication");
+    const char* handle = PORTAL_PATH "/request/test/1";
+    const char* app_id = "";
+    const char* parent_window = "";
+    dbus_message_append_args(msg, DBUS_TYPE_OBJECT_PATH, &handle, DBUS_TYPE_STRING, &app_id,
+                             DBUS_TYPE_STRING, &parent_window, DBUS_TYPE_ARRAY,
+                             DBUS_TYPE_STRING, &choices, n, DBUS_TYPE_INVALID);
+    DBusMessageIter args, dict;
+    dbus_message_iter_init_append(msg, &args);
+    dbus_message_iter_open_container(&args, DBUS_TYPE_ARRAY, "{sv}", &dict);
+    const char* keys[] = {"uri", "last_choice"};
+    const char* values[] = {uri, last_choice};
+    for (int i = 0; i < 2; ++i) {
+        if (!values[i]) continue;
+        DBusMessageIter entry, variant;
+        dbus_message_iter_open_container(&dict, DBUS_TYPE_DICT_ENTRY, NULL, &entry);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &keys[i]);
+        dbus_message_iter_open_container(&entry, DBUS_TYPE_VARIANT, "s", &variant);
+        dbus_message_iter_append_basic(&variant, DBUS_TYPE_STRING, &values[i]);
+        dbus_message_iter_close_container(&entry, &variant);
+        dbus_message_iter_close_container(&dict, &entry);
+    }
+    dbus_message_iter_close_container(&args, &dict);
+
+    DBusError error;
+    dbus_error_init(&error);
+    DBusMessage* reply = dbus_connection_send_with_reply_and_block(connection, msg, 5000,
+                                                                   &error);
+    dbus_message_unref(msg);
+    if (!reply) {
+        fprintf(stderr, "ChooseApplication(%s) failed: %s\n", uri, error.message);
+        dbus_error_free(&error);
+        return 1;
+    }
+    dbus_uint32_t response = 2;
+    const char* choice = NULL;
+    dbus_message_iter_init(reply, &args);
+    dbus_message_iter_get_basic(&args, &response);
+    dbus_message_iter_next(&args);
+    dbus_message_iter_recurse(&args, &dict);
+    for (; dbus_message_iter_get_arg_type(&dict) == DBUS_TYPE_DICT_ENTRY;
+         dbus_message_iter_next(&dict)) {
+        DBusMessageIter entry, variant;
+        const char* key;
+        dbus_message_iter_recurse(&dict, &entry);
+        dbus_message_iter_get_basic(&entry, &key);
+        dbus_message_iter_next(&entry);
+        dbus_message_iter_recurse(&entry, &variant);
+        if (strcmp(key, "choice") == 0) dbus_message_iter_get_basic(&variant, &choice);
+    }
+    int res = expected ? response != 0 || !choice || strcmp(choice, expected) != 0
+                       : response == 0;
+    printf("%s %s: response %u, choice %s (expected %s)\n", res ? "FAIL" : "ok", uri,
+           response, choice ? choice : "none", expected ? expected : "none");
+    dbus_message_unref(reply);
+    return res;
+}
+
+int main(int argc, char* argv[]) {
+    const char* dbus_daemon = "dbus-daemon";
+    int opt;
+    while ((opt = getopt(argc, argv, "d:")) != -1) {
+        if (opt == 'd') {
+            dbus_daemon = optarg;
+        } else {
+            optind = argc + 1;
+        }
+    }
+    if (argc - optind != 2) {
+        fprintf(stderr, "Usage: %s [-d dbus-daemon] <aperi_portal> <aperi>\n", argv[0]);
+        return 2;
+    }
+    // the test config, as in test.sh
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) return 1;
+    char* config;
+    char* data;
+    if (asprintf(&config, "%s/config", cwd) < 0 || asprintf(&data, "%s/data", cwd) < 0) {
+        return 1;
+    }
+    setenv("XDG_CONFIG_HOME", config, 1);
+    setenv("XDG_DATA_HOME", data, 1);
+    setenv("XDG_DATA_DIRS", data, 1);
+
+    pid_t bus_pid = private_bus_start(dbus_daemon);
+    if (bus_pid < 0) return 1;
+    DBusError error;
+    dbus_error_init(&error);
+    DBusConnection* connection = dbus_connection_open_private(
+            getenv("DBUS_SESSION_BUS_ADDRESS"), &error);
+    if (!connection || !dbus_bus_register(connection, &error)) {
+        fprintf(stderr, "Connection Error (%s)\n", error.message);
+        dbus_error_free(&error);
+        private_bus_stop(bus_pid);
+        return 1;
+    }
+    char* portal_argv[] = {argv[optind], argv[optind + 1], NULL};
+    pid_t portal_pid = -1;
+    int res = posix_spawn(&portal_pid, argv[optind], NULL, NULL, portal_argv, environ);
+    if (res) {
+        fprintf(stderr, "Couldn't start %s: %s\n", argv[optind], strerror(res));
+    } else if ((res = wait_portal(connection))) {
+        fprintf(stderr, "%s didn't acquire %s\n", argv[optind], PORTAL_NAME);
+    } else {
+        char *desktop_uri, *command_uri;
+        if (asprintf(&desktop_uri, "file://%s/files/test.s", cwd) < 0 ||
+            asprintf(&command_uri, "file://%s/files/test.a", cwd) < 0) {
+            return 1;
+        }
+        // `s=@aperi-test.desktop`
+        const char* desktop_choices[] = {"org.example.Other", "aperi-test", "aperi"};
+        res |= check_choice(connection, desktop_uri, desktop_choices, 3, NULL, "aperi-test");
+        // `a=echo 1`: aperi runs the command
+        res |= check_choice(connection, command_uri, desktop_choices, 3, NULL, "aperi");
+        // relative paths aren't queried, like the bare file names of the portal
+        res |= check_choice(connection, "files/test.s", desktop_choices, 3, NULL, "aperi");
+        // no rule choice available: the last one or the first one
+        const char* other_choices[] = {"org.example.Other", "org.example.Last"};
+        res |= check_choice(connection, desktop_uri, other_choices, 2, "org.example.Last",
+                            "org.example.Last");
+        res |= check_choice(connection, "nothing://", other_choices, 2, NULL,
+                            "org.example.Other");
+        res |= check_choice(connection, desktop_uri, NULL, 0, NULL, NULL);
+        free(desktop_uri);
+        free(command_uri);
+    }
+    if (portal_pid > 0) {
+        kill(portal_pid, SIGTERM);
+        waitpid(portal_pid, NULL, 0);
+    }
+    dbus_connection_close(connection);
+    dbus_connection_unref(connection);
+    private_bus_stop(bus_pid);
+    free(config);
+    free(data);
+    return res != 0;
+}
@@ -0,0 +1,51 @@
+#define _GNU_SOURCE 1
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "private_bus.h"
+
+extern char** environ;
+
+pid_t private_bus_start(const char* dbus_daemon) {
+    int fds[2];
+    if (pipe(fds)) return -1;
+    char address_fd[32];
+    snprintf(address_fd, sizeof(address_fd), "--print-address=%d", fds[1]);
+    char* argv[] = {(char*)dbus_daemon, "--session", "--nofork", address_fd, NULL};
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addclose(&actions, fds[0]);
+    pid_t pid;
+    int res = posix_spawnp(&pid, dbus_daemon, &actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+    if (res) {
+        fprintf(stderr, "Couldn't start %s: %s\n", dbus_daemon, strerror(res));
+        close(fds[0]);
+        return -1;
+    }
+    char address[1024];
+    ssize_t ln = 0;
+    while (ln < (ssize_t)sizeof(address) - 1 && read(fds[0], address + ln, 1) > 0) {
+        if (address[ln] == '\n') break;
+        ++ln;
+    }
+    close(fds[0]);
+    address[ln] = 0;
+    if (ln == 0) {
+        fprintf(stderr, "Couldn't read the address of the bus\n");
+        private_bus_stop(pid);
+        return -1;
+    }
+    setenv("DBUS_SESSION_BUS_ADDRESS", address, 1);
+    return pid;
+}
+
+void private_bus_stop(pid_t pid) {
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+}
@@ -0,0 +1,15 @@
+#ifndef PRIVATE_BUS_H
+#define PRIVATE_BUS_H
+
+#include <sys/types.h>
+
+/* Private session bus for the benchmarks, so that they don't need a running desktop */
+
+/* Start `dbus_daemon` (searched in PATH) as a private session bus and set
+ * $DBUS_SESSION_BUS_ADDRESS to its address. Return the pid of the bus or -1 on errors. */
+pid_t private_bus_start(const char* dbus_daemon);
+
+/* Stop the bus started by private_bus_start() */
+void private_bus_stop(pid_t pid);
+
+#endif
@@ -2,10 +2,89 @@
 set -e
 BASEDIR=$(dirname "$0")
 export XDG_CONFIG_HOME="$BASEDIR/config"
-tmpfile=$(mktemp /tmp/aperi_tests.XXXXXX)
-exec 3>"$tmpfile"
-exec 4<"$tmpfile"
-rm "$tmpfile"
-for f in files/* http://test http://youtu.be/; do echo "===$f==="; ../build/aperi "$f"; echo; done |\
-    sed "s|$(realpath ../tests/files)/||g" >&3
-diff --from-file=- reference.out <&4
+export XDG_DATA_HOME="$BASEDIR/data"
+export XDG_DATA_DIRS="$BASEDIR/data"
+tmpdir=$(mktemp -d /tmp/aperi_tests_cache.XXXXXX)
+# .aperi files writable by others are ignored
+chmod go-w files/local/.aperi
+trap 'rm -rf "$tmpdir" config/aperi/config.compiled' EXIT
+# the deflated and gzip compressed members are only supported by the builds with zlib
+if ../build/aperi | grep -q '^Built with:.* zlib'; then
+    compressed_reference=reference_zlib.out
+else
+    compressed_reference=reference_nozlib.out
+fi
+
+# Run the test cases with the cache, state and runtime directory `$tmpdir/$1` and compare
+# their output with reference.out, and the one of the compressed archive members with
+# $compressed_reference
+run_suite() {
+    XDG_CACHE_HOME="$tmpdir/$1"
+    mkdir "$XDG_CACHE_HOME"
+    export XDG_CACHE_HOME
+    export XDG_RUNTIME_DIR="$XDG_CACHE_HOME"
+    export XDG_STATE_HOME="$XDG_CACHE_HOME"
+    {
+        for f in files/* http://test http://youtu.be/ http://www.glob.test/page; do echo "===$f==="; ../build/aperi "$f"; echo; done
+        echo "===stdin==="; printf "piped" | ../build/aperi --as y -; echo
+        echo "===stdin sniffed==="; printf "%%PDF-1.4" | ../build/aperi -; echo
+        echo "===local override==="; ../build/aperi files/local/sub/test.a; echo
+        echo "===archive member==="; ../build/aperi "archives/test.tar#docs/member.y"; echo
+        echo "===zip stored member==="; ../build/aperi "archives/test.zip#docs/stored.y"; echo
+        echo "===zip crc error==="; ../build/aperi "archives/bad-crc.zip#docs/stored.y" 2>/dev/null || echo failed; echo
+        # the first open starts the server, --warm skips it (and the most hit server, of a
+        # rule no longer in the config) and the second one finds it live
+        mkdir -p "$XDG_STATE_HOME/aperi"
+        printf '100\t@aperi-deleted\techo deleted\n' > "$XDG_STATE_HOME/aperi/hits"
+        echo "===server rule==="; ../build/aperi server/test.srv; ../build/aperi --warm 1
+        ../build/aperi server/test.srv; cut -f1 "$XDG_STATE_HOME/aperi/hits"; echo
+    } |\
+        sed "s|$(realpath ../tests/files)/||g" > "$tmpdir/$1.out"
+    diff "$tmpdir/$1.out" reference.out
+    {
+        echo "===zip deflated member==="
+        ../build/aperi "archives/test.zip#docs/deflated.y" 2>/dev/null || echo unsupported; echo
+        long_dir=docs/a-rather-long-directory-name/a-rather-long-directory-name/a-rather-long-directory-name
+        echo "===tgz long names==="
+        for m in gnu pax; do
+            ../build/aperi "archives/test.tgz#$long_dir/$m-long-name.y" 2>/dev/null || echo unsupported
+        done
+        echo
+    } > "$tmpdir/$1.compressed.out"
+    diff "$tmpdir/$1.compressed.out" "$compressed_reference"
+}
+
+run_suite text
+
+# the same cases with the config compiled by aperi_compile, with a first rule telling it
+# apart from the text config
+{ echo "compiled://=echo compiled"; cat config/aperi/config; } > "$tmpdir/config"
+../build/aperi_compile "$tmpdir/config" config/aperi/config.compiled
+run_suite compiled
+if [ "$(../build/aperi compiled://rules)" != "compiled compiled://rules" ]; then
+    echo "The compiled config isn't used"
+    exit 1
+fi
+# a compiled config older than the text one is ignored
+touch -t 197001020000 config/aperi/config.compiled
+if [ "$(../build/aperi compiled://rules)" != "999 compiled://rules" ]; then
+    echo "The outdated compiled config is used"
+    exit 1
+fi
+
+# wipewine -m restores the stolen (application/pdf), duplicated (text/html) and removed
+# (text/plain) entries of the guarded mimeapps.list, that is a symbolic link kept in place,
+# without changing its mode. The deprecated copy, a link to the same file, is skipped
+mkdir -p "$tmpdir/mimeapps/config/dotfiles" "$tmpdir/mimeapps/data/applications"
+cp mimeapps/stolen.list "$tmpdir/mimeapps/config/dotfiles/mimeapps.list"
+chmod 640 "$tmpdir/mimeapps/config/dotfiles/mimeapps.list"
+ln -s dotfiles/mimeapps.list "$tmpdir/mimeapps/config/mimeapps.list"
+ln -s ../../config/mimeapps.list "$tmpdir/mimeapps/data/applications/mimeapps.list"
+XDG_CONFIG_HOME="$tmpdir/mimeapps/config" XDG_DATA_HOME="$tmpdir/mimeapps/data" \
+    timeout 1 ../build/wipewine -m mimeapps/desired.list > /dev/null || true
+if [ ! -L "$tmpdir/mimeapps/config/mimeapps.list" ] ||
+   [ "$(stat -c %a "$tmpdir/mimeapps/config/dotfiles/mimeapps.list")" != 640 ]; then
+    echo "The link or the mode of the guarded mimeapps.list changed"
+    exit 1
+fi
+diff "$tmpdir/mimeapps/config/mimeapps.list" mimeapps/reference.list
@@ -0,0 +1,208 @@
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <pwd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "util.h"
+
+void *xmalloc(size_t size) {
+    void* p = malloc(size);
+    if(!p) {
+        perror("Error allocating memory");
+        fprintf(stderr, "Aborting...\n");
+        exit(1);
+    }
+    return p;
+}
+
+void *xrealloc(void* p, size_t size) {
+    void* new_p = realloc(p, size);
+    if(!new_p) {
+        perror("Error reallocating memory");
+        fprintf(stderr, "Aborting...\n");
+        exit(1);
+    }
+    return new_p;
+}
+
+char *xrealpath(const char *path, char *resolved_path) {
+    char *res = realpath(path, resolved_path);
+    if(!res) {
+        perror("Error in realpath");
+    }
+    return res;
+}
+
+void percent_decode(char* s) {
+    char* src = s;
+    char* dest = s;
+    // counter of digits to decode
+    int decode = 0;
+    // decoded char
+    char c;
+    while(*src) {
+        if (decode > 0) {
+            c = c << 4;
+            if ('0' <= *src && *src <= '9') c += *src - '0';
+            if ('A' <= *src && *src <= 'F') c += *src - 'A' + 10;
+            if ('a' <= *src && *src <= 'f') c += *src - 'a' + 10;
+            --decode;
+            if (decode == 0) {
+                *dest = c;
+                ++dest;
+            }
+        } else if(*src == '%') {
+            decode = 2;
+            c = 0;
+        } else {
+            *dest = *src;
+            ++dest;
+        }
+        ++src;
+    }
+    *dest = 0;
+}
+
+char* shell_quote(const char* s) {
+    int safe = *s != 0;
+    size_t quotes = 0;
+    for (const char* c = s; *c; ++c) {
+        if (!isalnum((unsigned char)*c) && !strchr("@%+=:,./-_", *c)) safe = 0;
+        if (*c == '\'') ++quotes;
+    }
+    if (safe) return strdup(s);
+    // each single quote is closed, escaped and reopened: ' -> '"'"'
+    char* res = xmalloc(strlen(s) + quotes * 4 + 3);
+    char* dest = res;
+    *dest++ = '\'';
+    for (const char* c = s; *c; ++c) {
+        if (*c == '\'') {
+            memcpy(dest, "'\"'\"'", 5);
+            dest += 5;
+        } else {
+            *dest++ = *c;
+        }
+    }
+    *dest++ = '\'';
+    *dest = 0;
+    return res;
+}
+
+int parse_size(const char* s, unsigned long long* res) {
+    char* end;
+    errno = 0;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (errno || end == s || *s == '-') return 1;
+    const char* suffixes = "KMGT";
+    const char* suffix = *end ? strchr(suffixes, *end) : NULL;
+    if (*end && (!suffix || end[1])) return 1;
+    if (suffix) {
+        for (const char* c = suffixes; c <= suffix; ++c) {
+            if (v > ULLONG_MAX / 1024) return 1;
+            v *= 1024;
+        }
+    }
+    *res = v;
+    return 0;
+}
+
+int isdir(const char* path) {
+    struct stat statbuf;
+    return stat(path, &statbuf) == 0 && (statbuf.st_mode & S_IFMT) == S_IFDIR;
+}
+
+int next_line(FILE* f) {
+    int c;
+    while(1) {
+        c = getc(f);
+        if (c == '\n' || c == '\r' || c == EOF) break;
+    }
+    ungetc(c, f);
+    while(1) {
+        c = getc(f);
+        if (c != '\n' && c != '\r') break;
+    }
+    ungetc(c, f);
+    return 0;
+}
+
+const char* get_homedir() {
+    struct passwd *pw = getpwuid(getuid());
+    if (!pw) return "/";
+    return pw->pw_dir;
+}
+
+int strnicmp(const char* s1, const char* s2, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        unsigned char c1 = tolower((unsigned char)s1[i]);
+        unsigned char c2 = tolower((unsigned char)s2[i]);
+        if(c1 != c2) {
+            return c1 < c2 ? -1 : 1;
+        }
+        if (c1 == 0) break;
+    }
+    return 0;
+}
+
+int mkdirs(const char* path, mode_t mode) {
+    char* p = strdup(path);
+    for (char* c = p + 1; *c; ++c) {
+        if (*c != '/') continue;
+        *c = 0;
+        if (mkdir(p, mode) != 0 && errno != EEXIST) {
+            free(p);
+            return 1;
+        }
+        *c = '/';
+    }
+    int res = mkdir(p, mode) != 0 && errno != EEXIST;
+    free(p);
+    return res;
+}
+
+char* xdg_aperi_path(const char* env, const char* fallback, const char* name) {
+    const char* base = getenv(env);
+    int ln;
+    if (base && *base) {
+        ln = snprintf(NULL, 0, "%s/aperi/", base);
+    } else {
+        ln = snprintf(NULL, 0, "%s/%s/aperi/", get_homedir(), fallback);
+    }
+    char* path = xmalloc(ln + strlen(name) + 1);
+    if (base && *base) {
+        snprintf(path, ln + 1, "%s/aperi/", base);
+    } else {
+        snprintf(path, ln + 1, "%s/%s/aperi/", get_homedir(), fallback);
+    }
+    mkdirs(path, 0700);
+    strcpy(path + ln, name);
+    return path;
+}
+
+FILE* atomic_open(const char* path, char** tmppath) {
+    *tmppath = xmalloc(strlen(path) + 8);
+    stpcpy(stpcpy(*tmppath, path), ".XXXXXX");
+    int fd = mkstemp(*tmppath);
+    FILE* f = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (!f) {
+        if (fd >= 0) {
+            close(fd);
+            unlink(*tmppath);
+        }
+        free(*tmppath);
+        *tmppath = NULL;
+    }
+    return f;
+}
+
+int atomic_commit(FILE* f, char* tmppath, const char* path) {
+    int res = fclose(f) != 0 || rename(tmppath, path) != 0;
+    if (res) unlink(tmppath);
+    free(tmppath);
+    return res;
+}
@@ -0,0 +1,58 @@
+#ifndef UTIL_H
+#define UTIL_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/* Like malloc, but print a message and exit in case of errors */
+void *xmalloc(size_t size);
+
+/* Like realloc, but print a message and exit in case of errors */
+void *xrealloc(void* p, size_t size);
+
+/* Like realpath, but print a message and exit in case of errors */
+char *xrealpath(const char *path, char *resolved_path);
+
+/* Percent decode `s` (see https://en.wikipedia.org/wiki/Percent-encoding) */
+void percent_decode(char* s);
+
+/* Return `s` quoted for the POSIX shell, like Python's shlex.quote(): strings made only of
+ * safe characters are returned as they are, the others are surrounded by single quotes.
+ * The result must be freed. */
+char* shell_quote(const char* s);
+
+/* Parse a size in bytes with an optional binary K/M/G/T suffix (like `64M`) into `res`.
+ * Return 0 on success. */
+int parse_size(const char* s, unsigned long long* res);
+
+/* return 1 if path is a directory, else 0 */
+int isdir(const char* path);
+
+/* skip to the next non empty line in file `f` */
+int next_line(FILE* f);
+
+/* return a pointer to a string containing the current user home directory.
+ * The string must not be modified or freed */
+const char* get_homedir();
+
+/* Like strncmp, but compare strings case insensitive (using tolower()) */
+int strnicmp(const char* s1, const char* s2, size_t n);
+
+/* Like mkdir -p: create `path` and all its missing parents. Return 0 on success */
+int mkdirs(const char* path, mode_t mode);
+
+/* Return the path of `name` inside the `aperi` subdirectory of the XDG base directory
+ * in the environment variable `env` (or in `$HOME/<fallback>` if it's not set), creating
+ * the `aperi` directory if needed. The result must be freed. */
+char* xdg_aperi_path(const char* env, const char* fallback, const char* name);
+
+/* Open a temporary file next to `path`, to be later renamed to `path` by
+ * atomic_commit(). Return NULL on errors. */
+FILE* atomic_open(const char* path, char** tmppath);
+
+/* Close `f` (opened by atomic_open()) and rename it to `path`. Frees `tmppath`. Return
+ * 0 on success. */
+int atomic_commit(FILE* f, char* tmppath, const char* path);
+
+#endif
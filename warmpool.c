@@ -0,0 +1,263 @@
+#define _GNU_SOURCE 1
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "warmpool.h"
+#include "util.h"
+
+#define HITS_NAME "hits"
+// interval between the checks of the socket of a starting server, in ms
+#define SERVER_POLL_MS 10
+
+// Server rule counted in the hits file, a line `<count>\t<socket>\t<server>`
+typedef struct Hit {
+    unsigned long count;
+    char* socket;
+    char* server;
+} Hit;
+
+/* Return `s` with the environment variables and a leading `~` expanded (to be freed) */
+static char* expand(const char* s);
+
+/* Start `server` in a detached process */
+static void server_start(const char* server);
+
+/* Parse the hits of the file `f` in `*hits` (to be freed with hits_free()). Return their
+ * number */
+static int hits_read(FILE* f, Hit** hits);
+
+static void hits_free(Hit* hits, int n);
+
+static char* expand(const char* s) {
+    size_t allocated = strlen(s) + 1;
+    size_t ln = 0;
+    char* res = xmalloc(allocated);
+    const char* home = s[0] == '~' && (s[1] == '/' || !s[1]) ? get_homedir() : NULL;
+    if (home) ++s;
+    while (home || *s) {
+        const char* value = home;
+        char c[2] = {*s, 0};
+        home = NULL;
+        int variable = s[1] == '{' || s[1] == '_' || isalpha((unsigned char)s[1]);
+        if (!value && *s == '$' && variable) {
+            // $NAME or ${NAME}
+            int braces = s[1] == '{';
+            const char* name = s + 1 + braces;
+            size_t name_ln = 0;
+            while (name[name_ln] == '_' || isalnum((unsigned char)name[name_ln])) ++name_ln;
+            if (braces && name[name_ln] != '}') {
+                value = c;
+                ++s;
+            } else {
+                char* var = strndup(name, name_ln);
+                value = getenv(var);
+                free(var);
+                if (!value) value = "";
+                s = name + name_ln + braces;
+            }
+        } else if (!value) {
+            value = c;
+            ++s;
+        }
+        size_t value_ln = strlen(value);
+        while (ln + value_ln + 1 > allocated) {
+            allocated *= 2;
+            res = xrealloc(res, allocated);
+        }
+        memcpy(res + ln, value, value_ln);
+        ln += value_ln;
+    }
+    res[ln] = 0;
+    return res;
+}
+
+int server_live(const char* socket_path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    size_t ln = strlen(socket_path);
+    if (ln == 0 || ln >= sizeof(addr.sun_path)) return 0;
+    memcpy(addr.sun_path, socket_path, ln);
+    // `@<name>`: abstract socket
+    if (socket_path[0] == '@') addr.sun_path[0] = 0;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return 0;
+    socklen_t addr_ln = offsetof(struct sockaddr_un, sun_path) + ln;
+    int res = connect(fd, (struct sockaddr*)&addr, addr_ln);
+    // a server with a different socket type is listening anyway
+    int live = res == 0 || errno == EPROTOTYPE;
+    close(fd);
+    return live;
+}
+
+static void server_start(const char* server) {
+    pid_t pid = fork();
+    if (pid < 0) return;
+    if (pid > 0) {
+        waitpid(pid, NULL, 0);
+        return;
+    }
+    // fork again so that the server is reparented and never becomes a zombie of the command
+    if (fork() != 0) _exit(0);
+    setsid();
+    int null = open("/dev/null", O_RDWR);
+    if (null >= 0) {
+        dup2(null, STDIN_FILENO);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        if (null > STDERR_FILENO) close(null);
+    }
+    execl("/bin/sh", "sh", "-c", server, (char*)NULL);
+    _exit(127);
+}
+
+int server_ensure(const char* server, const char* socket_path) {
+    char* path = expand(socket_path);
+    int res = 0;
+    if (!server_live(path)) {
+        // expanded by the shell: values expanded here too would be split and interpreted again
+        server_start(server);
+        struct timespec interval = {0, SERVER_POLL_MS * 1000000L};
+        int waited = 0;
+        while (!server_live(path) && waited < SERVER_START_TIMEOUT_MS) {
+            nanosleep(&interval, NULL);
+            waited += SERVER_POLL_MS;
+        }
+        if (waited >= SERVER_START_TIMEOUT_MS) {
+            fprintf(stderr, "Server %s not listening on %s after %d ms\n", server, path,
+                    SERVER_START_TIMEOUT_MS);
+            res = 1;
+        }
+    }
+    free(path);
+    return res;
+}
+
+static int hits_read(FILE* f, Hit** hits) {
+    int n = 0;
+    *hits = NULL;
+    char* line = NULL;
+    size_t allocated = 0;
+    ssize_t ln;
+    while ((ln = getline(&line, &allocated, f)) >= 0) {
+        if (ln > 0 && line[ln - 1] == '\n') line[ln - 1] = 0;
+        char* socket_path = strchr(line, '\t');
+        char* server = socket_path ? strchr(socket_path + 1, '\t') : NULL;
+        // invalid lines (like the ones of a concurrent crash) are dropped
+        if (!server) continue;
+        *socket_path++ = 0;
+        *server++ = 0;
+        *hits = xrealloc(*hits, (n + 1) * sizeof(Hit));
+        (*hits)[n].count = strtoul(line, NULL, 10);
+        (*hits)[n].socket = strdup(socket_path);
+        (*hits)[n++].server = strdup(server);
+    }
+    free(line);
+    return n;
+}
+
+static void hits_free(Hit* hits, int n) {
+    for (int i = 0; i < n; ++i) {
+        free(hits[i].socket);
+        free(hits[i].server);
+    }
+    free(hits);
+}
+
+void warm_record_hit(const char* server, const char* socket_path) {
+    // the values are stored in a line of tab separated fields
+    if (strpbrk(server, "\t\n") || strpbrk(socket_path, "\t\n")) return;
+    char* path = xdg_aperi_path("XDG_STATE_HOME", ".local/state", HITS_NAME);
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    free(path);
+    if (fd < 0) return;
+    // updated in place under the lock, so that concurrent launches are all counted
+    FILE* f = fdopen(fd, "r+");
+    if (!f) {
+        close(fd);
+        return;
+    }
+    if (flock(fd, LOCK_EX) != 0) {
+        fclose(f);
+        return;
+    }
+    Hit* hits;
+    int n = hits_read(f, &hits);
+    int found = 0;
+    rewind(f);
+    for (int i = 0; i < n; ++i) {
+        if (strcmp(hits[i].socket, socket_path) == 0 && strcmp(hits[i].server, server) == 0) {
+            ++hits[i].count;
+            found = 1;
+        }
+        fprintf(f, "%lu\t%s\t%s\n", hits[i].count, hits[i].socket, hits[i].server);
+    }
+    if (!found) fprintf(f, "1\t%s\t%s\n", socket_path, server);
+    fflush(f);
+    if (ftruncate(fd, ftell(f)) != 0) {
+        fprintf(stderr, "Couldn't update the hits file: %s\n", strerror(errno));
+    }
+    hits_free(hits, n);
+    fclose(f);
+}
+
+static int cmp_hits(const void* a, const void* b) {
+    unsigned long x = ((const Hit*)a)->count;
+    unsigned long y = ((const Hit*)b)->count;
+    return x > y ? -1 : x < y;
+}
+
+int warm_start(int n, char* const* servers, char* const* sockets, int n_rules) {
+    char* path = xdg_aperi_path("XDG_STATE_HOME", ".local/state", HITS_NAME);
+    FILE* f = fopen(path, "r");
+    free(path);
+    // nothing recorded yet
+    if (!f) return 0;
+    flock(fileno(f), LOCK_SH);
+    Hit* hits;
+    int n_hits = hits_read(f, &hits);
+    fclose(f);
+    // the hits of rules no longer in the config are dropped
+    int kept = 0;
+    for (int i = 0; i < n_hits; ++i) {
+        int active = 0;
+        for (int r = 0; r < n_rules && !active; ++r) {
+            active = strcmp(hits[i].server, servers[r]) == 0 &&
+                     strcmp(hits[i].socket, sockets[r]) == 0;
+        }
+        if (active) {
+            hits[kept++] = hits[i];
+        } else {
+            free(hits[i].socket);
+            free(hits[i].server);
+        }
+    }
+    n_hits = kept;
+    qsort(hits, n_hits, sizeof(Hit), cmp_hits);
+    for (int i = 0; i < n_hits && i < n; ++i) {
+        // rules sharing a server are started once
+        int started = 0;
+        for (int j = 0; j < i; ++j) started |= strcmp(hits[j].socket, hits[i].socket) == 0;
+        if (started) {
+            ++n;
+            continue;
+        }
+        char* socket_path = expand(hits[i].socket);
+        if (!server_live(socket_path)) {
+            printf("Starting %s (%lu hits)\n", hits[i].server, hits[i].count);
+            server_start(hits[i].server);
+        }
+        free(socket_path);
+    }
+    hits_free(hits, n_hits);
+    return 0;
+}
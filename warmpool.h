@@ -0,0 +1,42 @@
+#ifndef WARMPOOL_H
+#define WARMPOOL_H
+
+/* Server/client rules and the warm pool of their servers.
+ *
+ * A rule with the `server=<command>` and `socket=<path>` modifiers runs its command as a
+ * client of the server listening on the unix socket `path` (`@<name>` for an abstract
+ * socket), like `txt=[server="emacs --daemon" socket=$XDG_RUNTIME_DIR/emacs/server]emacsclient -c`:
+ * if nothing accepts connections on the socket, the server command is started with
+ * `sh -c`, detached from aperi, and the client runs as soon as the socket is live.
+ * Environment variables (`$NAME`, `${NAME}`) and a leading `~` are expanded in the socket
+ * path. The server command is left to the shell, which expands them itself.
+ *
+ * Every launch of a server rule is counted in `$XDG_STATE_HOME/aperi/hits`, and
+ * `aperi --warm [N]`, run at login, starts the servers of the N most hit rules of the
+ * config (the ones of the `.aperi` files aren't known at login), so that opening a file
+ * doesn't pay for the startup of a heavyweight server. */
+
+// Maximum time waited for a server to create its socket, in ms
+#define SERVER_START_TIMEOUT_MS 10000
+// Servers started by `aperi --warm` without a count
+#define WARM_DEFAULT_SERVERS 3
+
+/* Return 1 if a server accepts connections on the socket `socket_path` (already
+ * expanded), else 0 */
+int server_live(const char* socket_path);
+
+/* Start the `server` command for the socket `socket_path`, unless it's already live, and
+ * wait until the socket is live. Return 0 if it's live, else print an error and return 1 */
+int server_ensure(const char* server, const char* socket_path);
+
+/* Count a launch of the rule with the modifiers `server` and `socket_path` (as written in
+ * the config) in the hits file */
+void warm_record_hit(const char* server, const char* socket_path);
+
+/* Start the servers of the `n` most hit rules that aren't running, without waiting for
+ * them. Only the hits of the rules still in the config, whose `n_rules` modifiers are
+ * `servers` and `sockets`, are counted: the ones of deleted or edited rules are ignored.
+ * Return 0 on success */
+int warm_start(int n, char* const* servers, char* const* sockets, int n_rules);
+
+#endif
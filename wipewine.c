@@ -10,11 +10,16 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/inotify.h>
+#include <sys/stat.h>
 #include <sys/select.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <time.h>
 #include <unistd.h>
+#include "probes.h"
+
+PROBE_SEMAPHORE(wipewine, event_received);
+PROBE_SEMAPHORE(wipewine, file_unlinked);
 
 /* Functions for a basic implementation of the systemd notify protocol. These
  * are derived from the standalone C implementation found in the sd_notify(3)
@@ -141,7 +146,7 @@ char* xdg_applications() {
     char* p;
     if (xdg_data_home) {
         // XDG_DATA_HOME set: use it
-        p = strncpy(res, xdg_data_home, BUFSIZE-1);
+        p = stpecpy(res, end, xdg_data_home);
     } else {
         // XDG_DATA_HOME not set: use $HOME/.local/share
         char* home = getenv("HOME");
@@ -184,6 +189,7 @@ int rm_associations() {
                 fprintf(stderr, "Error unlinking %s: ", dp->d_name);
                 perror("");
             } else {
+                PROBE1(wipewine, file_unlinked, dp->d_name);
                 printf("Unlinked %s\n", dp->d_name);
             }
         }
@@ -192,6 +198,361 @@ int rm_associations() {
     return 0;
 }
 
+/* mimeapps.list guard.
+ *
+ * With `-m <mimeapps.list>` wipewine also watches the user mimeapps.list (in
+ * $XDG_CONFIG_HOME, and the deprecated copy in $XDG_DATA_HOME/applications) and restores
+ * the entries of the `[Default Applications]` section of the given file (like
+ * extra/mimeapps.list) that other applications changed or removed. The desired entries
+ * are kept in a hash index, and the last content known to be good is remembered so that
+ * the events caused by unrelated or own writes are skipped without parsing. */
+
+#define DEFAULT_APPLICATIONS "[Default Applications]"
+#define MIMEAPPS_LIST "mimeapps.list"
+
+// Desired entry of the [Default Applications] section
+typedef struct Entry {
+    char* key;
+    char* value;
+    // generation of the last check that found the entry
+    unsigned seen;
+} Entry;
+
+typedef struct Desired {
+    // entries in the order of the desired file
+    Entry* entries;
+    size_t n_entries;
+    // open addressing hash table of indexes in `entries` + 1 (0 for empty slots)
+    size_t* table;
+    size_t table_size;
+    // generation of the current check
+    unsigned generation;
+} Desired;
+
+// A watched mimeapps.list
+typedef struct Guard {
+    char* path;
+    // watch descriptor of its directory
+    int wd;
+    // the file is skipped if it's a symbolic link (to the other guarded file)
+    bool skip_symlink;
+    // last content of the file known to be good
+    char* good;
+    size_t good_len;
+} Guard;
+
+/* malloc() and realloc() exiting on errors: nothing can be guarded without memory */
+static void* xmalloc(size_t size);
+static void* xrealloc(void* p, size_t size);
+
+static void* xmalloc(size_t size) {
+    return xrealloc(NULL, size);
+}
+
+static void* xrealloc(void* p, size_t size) {
+    p = realloc(p, size);
+    if (!p) {
+        perror("Error allocating memory");
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+/* FNV-1a hash of the first `len` characters of `s` */
+static size_t hash_string(const char* s, size_t len) {
+    size_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/* Return the desired entry with key `key` (`len` characters), or NULL */
+static Entry* desired_find(Desired* desired, const char* key, size_t len) {
+    size_t mask = desired->table_size - 1;
+    for (size_t i = hash_string(key, len) & mask; desired->table[i]; i = (i + 1) & mask) {
+        Entry* entry = &desired->entries[desired->table[i] - 1];
+        if (strncmp(entry->key, key, len) == 0 && entry->key[len] == 0) return entry;
+    }
+    return NULL;
+}
+
+/* Read the whole file `path` in a new buffer and set `len`. Return NULL on errors */
+static char* read_file(const char* path, size_t* len) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return NULL;
+    size_t allocated = 65536;
+    char* res = xmalloc(allocated);
+    *len = 0;
+    size_t n;
+    while ((n = fread(res + *len, 1, allocated - *len - 1, f)) > 0) {
+        *len += n;
+        if (*len + 1 == allocated) {
+            allocated *= 2;
+            res = xrealloc(res, allocated);
+        }
+    }
+    res[*len] = 0;
+    fclose(f);
+    return res;
+}
+
+/* Split the `key=value` line `line` (`len` characters, without line end). Return the
+ * length of the key, or 0 if the line isn't an entry */
+static size_t entry_key_len(const char* line, size_t len) {
+    const char* eq = memchr(line, '=', len);
+    return eq && eq != line && line[0] != '#' ? (size_t)(eq - line) : 0;
+}
+
+/* Load the [Default Applications] entries of `path` in `desired`. Return 0 on success */
+static int desired_load(Desired* desired, const char* path) {
+    size_t len;
+    char* content = read_file(path, &len);
+    if (!content) {
+        fprintf(stderr, "Couldn't read %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    memset(desired, 0, sizeof(Desired));
+    size_t allocated = 256;
+    desired->entries = xmalloc(allocated * sizeof(Entry));
+    bool in_section = false;
+    for (char* line = content; line < content + len; ) {
+        size_t line_len = strcspn(line, "\r\n");
+        char* next = line + line_len + 1;
+        line[line_len] = 0;
+        size_t key_len;
+        if (line[0] == '[') {
+            in_section = strcmp(line, DEFAULT_APPLICATIONS) == 0;
+        } else if (in_section && (key_len = entry_key_len(line, line_len))) {
+            if (desired->n_entries == allocated) {
+                allocated *= 2;
+                desired->entries = xrealloc(desired->entries, allocated * sizeof(Entry));
+            }
+            Entry* entry = &desired->entries[desired->n_entries++];
+            entry->key = xmalloc(key_len + 1);
+            memcpy(entry->key, line, key_len);
+            entry->key[key_len] = 0;
+            entry->value = xmalloc(line_len - key_len);
+            memcpy(entry->value, line + key_len + 1, line_len - key_len);
+            entry->seen = 0;
+        }
+        line = next;
+    }
+    free(content);
+
+    desired->table_size = 16;
+    while (desired->table_size < desired->n_entries * 2) desired->table_size *= 2;
+    desired->table = xmalloc(desired->table_size * sizeof(size_t));
+    memset(desired->table, 0, desired->table_size * sizeof(size_t));
+    size_t mask = desired->table_size - 1;
+    for (size_t e = 0; e < desired->n_entries; ++e) {
+        Entry* entry = &desired->entries[e];
+        if (desired_find(desired, entry->key, strlen(entry->key))) continue;
+        size_t i = hash_string(entry->key, strlen(entry->key)) & mask;
+        while (desired->table[i]) i = (i + 1) & mask;
+        desired->table[i] = e + 1;
+    }
+    printf("Guarding %zu entries of %s\n", desired->n_entries, path);
+    return 0;
+}
+
+/* Append `len` characters of `s` to the buffer `buf` */
+static void buf_append(char** buf, size_t* len, size_t* allocated, const char* s, size_t n) {
+    while (*len + n + 1 > *allocated) {
+        *allocated *= 2;
+        *buf = xrealloc(*buf, *allocated);
+    }
+    memcpy(*buf + *len, s, n);
+    *len += n;
+    (*buf)[*len] = 0;
+}
+
+/* Append the desired entries not seen in the current check to the buffer */
+static void append_missing(Desired* desired, char** buf, size_t* len, size_t* allocated,
+                           int* restored) {
+    for (size_t e = 0; e < desired->n_entries; ++e) {
+        Entry* entry = &desired->entries[e];
+        if (entry->seen == desired->generation) continue;
+        entry->seen = desired->generation;
+        buf_append(buf, len, allocated, entry->key, strlen(entry->key));
+        buf_append(buf, len, allocated, "=", 1);
+        buf_append(buf, len, allocated, entry->value, strlen(entry->value));
+        buf_append(buf, len, allocated, "\n", 1);
+        ++*restored;
+    }
+}
+
+/* Append the desired entries not seen in the current check at the end of the section in
+ * the buffer: before its empty lines, from `blank` to `end` in the input (NULL if the
+ * section doesn't end with empty lines) and written at `blank_len` of the buffer */
+static void end_section(Desired* desired, char** buf, size_t* len, size_t* allocated,
+                        const char* blank, const char* end, size_t blank_len, int* restored) {
+    if (!blank) {
+        append_missing(desired, buf, len, allocated, restored);
+        return;
+    }
+    *len = blank_len;
+    append_missing(desired, buf, len, allocated, restored);
+    buf_append(buf, len, allocated, blank, end - blank);
+}
+
+/* Write `len` bytes of `content` to `path` atomically (through a temporary file renamed
+ * over it), keeping its permissions. Return 0 on success */
+static int write_atomically(const char* path, const char* content, size_t len) {
+    size_t path_len = strlen(path);
+    char* tmp = xmalloc(path_len + 8);
+    stpcpy(stpcpy(tmp, path), ".XXXXXX");
+    int fd = mkstemp(tmp);
+    FILE* f = fd >= 0 ? fdopen(fd, "wb") : NULL;
+    if (!f && fd >= 0) close(fd);
+    int res = !f;
+    // the temporary file is private: give it the mode of the file it replaces
+    struct stat st;
+    if (!res && stat(path, &st) == 0) res = fchmod(fd, st.st_mode & 07777) != 0;
+    if (!res) res = fwrite(content, 1, len, f) != len;
+    if (f && fclose(f) != 0) res = 1;
+    if (!res) res = rename(tmp, path) != 0;
+    if (res) {
+        fprintf(stderr, "Error writing %s: %s\n", path, strerror(errno));
+        if (fd >= 0) unlink(tmp);
+    }
+    free(tmp);
+    return res;
+}
+
+/* Check the guarded file and restore the desired entries changed or removed by others */
+static void guard_check(Guard* guard, Desired* desired) {
+    struct stat st;
+    if (lstat(guard->path, &st) != 0) return;
+    if (guard->skip_symlink && S_ISLNK(st.st_mode)) return;
+    size_t len;
+    char* content = read_file(guard->path, &len);
+    if (!content) return;
+    // written by us, or unchanged since the last check
+    if (guard->good && len == guard->good_len && memcmp(content, guard->good, len) == 0) {
+        free(content);
+        return;
+    }
+
+    ++desired->generation;
+    size_t allocated = len + 4096;
+    size_t out_len = 0;
+    char* out = xmalloc(allocated);
+    out[0] = 0;
+    int restored = 0;
+    bool in_section = false;
+    bool found_section = false;
+    // empty lines since the last line written to `out`, and the length of `out` before them
+    const char* blank = NULL;
+    size_t blank_out_len = 0;
+    for (const char* line = content; line < content + len; ) {
+        size_t line_len = strcspn(line, "\r\n");
+        const char* next = line + line_len;
+        if (next < content + len) ++next;
+        size_t key_len;
+        Entry* entry = NULL;
+        if (line_len == 0) {
+            if (!blank) {
+                blank = line;
+                blank_out_len = out_len;
+            }
+        } else if (line[0] == '[') {
+            // the missing entries are added at the end of the section, before its empty lines
+            if (in_section) {
+                end_section(desired, &out, &out_len, &allocated, blank, line, blank_out_len,
+                            &restored);
+            }
+            in_section = line_len == strlen(DEFAULT_APPLICATIONS) &&
+                         strncmp(line, DEFAULT_APPLICATIONS, line_len) == 0;
+            found_section = found_section || in_section;
+        } else if (in_section && (key_len = entry_key_len(line, line_len))) {
+            entry = desired_find(desired, line, key_len);
+        }
+        if (line_len > 0) blank = NULL;
+        if (entry && entry->seen == desired->generation) {
+            // duplicated entry, that could override the restored one: drop it
+            ++restored;
+            line = next;
+            continue;
+        } else if (entry) {
+            entry->seen = desired->generation;
+            size_t value_len = line_len - key_len - 1;
+            if (strlen(entry->value) != value_len ||
+                strncmp(entry->value, line + key_len + 1, value_len) != 0) {
+                // stolen entry: write the desired value instead
+                buf_append(&out, &out_len, &allocated, line, key_len + 1);
+                buf_append(&out, &out_len, &allocated, entry->value, strlen(entry->value));
+                buf_append(&out, &out_len, &allocated, "\n", 1);
+                ++restored;
+                line = next;
+                continue;
+            }
+        }
+        buf_append(&out, &out_len, &allocated, line, next - line);
+        line = next;
+    }
+    if (out_len > 0 && out[out_len - 1] != '\n') buf_append(&out, &out_len, &allocated, "\n", 1);
+    if (!found_section) {
+        if (out_len > 0) buf_append(&out, &out_len, &allocated, "\n", 1);
+        buf_append(&out, &out_len, &allocated, DEFAULT_APPLICATIONS "\n",
+                   strlen(DEFAULT_APPLICATIONS) + 1);
+        in_section = true;
+        blank = NULL;
+    }
+    if (in_section) {
+        end_section(desired, &out, &out_len, &allocated, blank, content + len, blank_out_len,
+                    &restored);
+    }
+    free(content);
+
+    if (restored > 0) {
+        // write next to the file a symbolic link points to, keeping the link
+        char* target = realpath(guard->path, NULL);
+        int res = write_atomically(target ? target : guard->path, out, out_len);
+        free(target);
+        if (res != 0) {
+            free(out);
+            return;
+        }
+    }
+    if (restored > 0) {
+        printf("Restored %d entries of %s\n", restored, guard->path);
+        fflush(stdout);
+    }
+    free(guard->good);
+    guard->good = out;
+    guard->good_len = out_len;
+}
+
+/* Path to $XDG_CONFIG_HOME. If $XDG_CONFIG_HOME is not set, use $HOME/.config instead */
+char* xdg_config_home() {
+    const char* xdg_config_home = getenv("XDG_CONFIG_HOME");
+    if (xdg_config_home) return strdup(xdg_config_home);
+    const char* home = getenv("HOME");
+    if (!home) return NULL;
+    char* res = xmalloc(strlen(home) + 9);
+    stpcpy(stpcpy(res, home), "/.config");
+    return res;
+}
+
+/* Set `guard` to watch the mimeapps.list in `dir`, adding the events of `mask` to the
+ * watch for `dir` of `inotify_fd` (IN_MASK_ADD keeps the events of an existing watch for
+ * the same directory, that has the same watch descriptor). Return 0 on success */
+static int guard_init(Guard* guard, int inotify_fd, const char* dir, uint32_t mask,
+                      bool skip_symlink) {
+    memset(guard, 0, sizeof(Guard));
+    guard->path = xmalloc(strlen(dir) + strlen(MIMEAPPS_LIST) + 2);
+    stpcpy(stpcpy(stpcpy(guard->path, dir), "/"), MIMEAPPS_LIST);
+    guard->skip_symlink = skip_symlink;
+    guard->wd = inotify_add_watch(inotify_fd, dir, mask | IN_MASK_ADD);
+    if (guard->wd == -1) {
+        fprintf(stderr, "inotify_add_watch %s: %s\n", dir, strerror(errno));
+        return 1;
+    }
+    return 0;
+}
+
 /* Main */
 #define BUF_LEN (10 * (sizeof(struct inotify_event) + NAME_MAX + 1))
 int main(int argc, char *argv[]) {
@@ -199,6 +560,24 @@ int main(int argc, char *argv[]) {
     ssize_t numRead;
     int retcode = EXIT_FAILURE;
 
+    // mimeapps.list with the entries to guard (-m)
+    const char* desired_path = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "m:")) != -1) {
+        if (opt == 'm') {
+            desired_path = optarg;
+        } else {
+            fprintf(stderr, "Usage: %s [-m <desired mimeapps.list>]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    Desired desired;
+    if (desired_path && desired_load(&desired, desired_path) != 0) return EXIT_FAILURE;
+    // guarded mimeapps.list files: the user one and the deprecated one
+    Guard guards[2];
+    int n_guards = 0;
+    char* config_home = NULL;
+
     /* Setup signal handler */
     struct sigaction sa = {
         .sa_handler = signal_handler,
@@ -229,6 +608,20 @@ int main(int argc, char *argv[]) {
         goto exit;
     }
 
+    if (desired_path) {
+        config_home = xdg_config_home();
+        if (!config_home) {
+            fprintf(stderr, "Neither XDG_CONFIG_HOME nor HOME are set\n");
+            goto exit;
+        }
+        const uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO;
+        if (guard_init(&guards[n_guards++], inotify_fd, config_home, mask, false) ||
+            guard_init(&guards[n_guards++], inotify_fd, xdg_data_home_path, mask, true)) {
+            goto exit;
+        }
+        for (int i = 0; i < n_guards; ++i) guard_check(&guards[i], &desired);
+    }
+
     /* change dir to xdg_applications so that we can later call unlink on the event->name
      * directly, without the need to allocate and concatenate c strings */
     if (chdir(xdg_data_home_path)) {
@@ -263,12 +656,21 @@ int main(int argc, char *argv[]) {
                 struct inotify_event *event = (struct inotify_event *)p;
 
                 p += sizeof(struct inotify_event) + event->len;
+                PROBE2(wipewine, event_received, event->name, event->mask);
+                if (event->len > 0 && strcmp(event->name, MIMEAPPS_LIST) == 0 &&
+                    event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+                    // a guarded mimeapps.list was written
+                    for (int i = 0; i < n_guards; ++i) {
+                        if (guards[i].wd == event->wd) guard_check(&guards[i], &desired);
+                    }
+                }
                 // if the file matches wine-extension*.desktop: unlink it at once
-                if (is_wine_desktop_file(event->name)) {
+                if (event->mask & IN_CREATE && is_wine_desktop_file(event->name)) {
                     if (unlink(event->name)) {
                         fprintf(stderr, "Error unlinking %s: ", event->name);
                         perror("");
                     } else {
+                        PROBE1(wipewine, file_unlinked, event->name);
                         printf("Unlinked %s\n", event->name);
                         fflush(stdout);
                     }
@@ -292,5 +694,18 @@ exit:
         close(inotify_fd);
     }
     free(xdg_data_home_path);
+    free(config_home);
+    for (int i = 0; i < n_guards; ++i) {
+        free(guards[i].path);
+        free(guards[i].good);
+    }
+    if (desired_path) {
+        for (size_t e = 0; e < desired.n_entries; ++e) {
+            free(desired.entries[e].key);
+            free(desired.entries[e].value);
+        }
+        free(desired.entries);
+        free(desired.table);
+    }
     return retcode;
 }
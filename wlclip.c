@@ -0,0 +1,359 @@
+#define _GNU_SOURCE 1
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "wlclip.h"
+
+// Object ids used by the client (wl_display is always 1)
+enum {
+    IdDisplay = 1,
+    IdRegistry,
+    IdSync,
+    IdSeat,
+    IdManager,
+    IdDevice,
+    IdSource,
+    IdPrimarySource,
+    IdSync2,
+};
+
+// Requests and events opcodes
+#define DISPLAY_SYNC 0
+#define DISPLAY_GET_REGISTRY 1
+#define DISPLAY_ERROR 0
+#define REGISTRY_BIND 0
+#define REGISTRY_GLOBAL 0
+#define CALLBACK_DONE 0
+#define MANAGER_CREATE_DATA_SOURCE 0
+#define MANAGER_GET_DATA_DEVICE 1
+#define DEVICE_SET_SELECTION 0
+#define DEVICE_SET_PRIMARY_SELECTION 2
+#define SOURCE_OFFER 0
+#define SOURCE_SEND 0
+#define SOURCE_CANCELLED 1
+
+#define WLR_MANAGER "zwlr_data_control_manager_v1"
+#define EXT_MANAGER "ext_data_control_manager_v1"
+
+// Mime types offered for the text
+static const char* MIME_TYPES[] = {"text/plain;charset=utf-8", "text/plain", "UTF8_STRING",
+                                   "TEXT", "STRING", NULL};
+
+typedef struct WlClient {
+    int fd;
+    // received bytes not yet parsed
+    unsigned char in[4096];
+    size_t in_len;
+    // file descriptors received and not yet used
+    int fds[16];
+    int n_fds;
+    // globals found in the registry (0 if missing)
+    uint32_t seat_name;
+    uint32_t manager_name;
+    uint32_t manager_version;
+    const char* manager_interface;
+    // the sync callback with this id is done
+    uint32_t sync_id;
+    int synced;
+    // number of selections still owned
+    int owned;
+    // text to serve
+    const char* text;
+} WlClient;
+
+// Request being marshalled
+typedef struct WlRequest {
+    uint32_t words[128];
+    int n;
+} WlRequest;
+
+/* Connect to the compositor socket. Return the socket or -1 */
+static int wl_connect();
+
+/* Start the request `opcode` of the object `id` */
+static void req_begin(WlRequest* req, uint32_t id);
+
+/* Append an uint32 (uint, new_id or object) or a string argument to `req` */
+static void req_uint(WlRequest* req, uint32_t v);
+static void req_string(WlRequest* req, const char* s);
+
+/* Send `req`. Return 0 on success */
+static int req_send(WlClient* wl, WlRequest* req, uint16_t opcode);
+
+/* Read a string argument from `args` (`len` bytes) at `*pos`, advancing it. Return NULL
+ * if the argument is invalid */
+static const char* arg_string(const unsigned char* args, size_t len, size_t* pos);
+
+/* Receive data and file descriptors from the compositor. Return 0 on success */
+static int wl_receive(WlClient* wl);
+
+/* Read and dispatch the next event. Return 0 on success */
+static int wl_dispatch(WlClient* wl);
+
+/* Send a sync request with id `id` and dispatch events until it's done. Return 0 on
+ * success */
+static int wl_roundtrip(WlClient* wl, uint32_t id);
+
+/* Create a data source offering the text and set it as the selection (`primary` 0) or as
+ * the primary selection. Return 0 on success */
+static int wl_set_selection(WlClient* wl, uint32_t source, int primary);
+
+static int wl_connect() {
+    const char* display = getenv("WAYLAND_DISPLAY");
+    if (!display || !*display) display = "wayland-0";
+    const char* runtime_dir = getenv("XDG_RUNTIME_DIR");
+    struct sockaddr_un sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    int ln;
+    if (display[0] == '/') {
+        ln = snprintf(sa.sun_path, sizeof(sa.sun_path), "%s", display);
+    } else if (runtime_dir) {
+        ln = snprintf(sa.sun_path, sizeof(sa.sun_path), "%s/%s", runtime_dir, display);
+    } else {
+        return -1;
+    }
+    if (ln >= (int)sizeof(sa.sun_path)) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr*)&sa, sizeof(sa)) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+static void req_begin(WlRequest* req, uint32_t id) {
+    req->words[0] = id;
+    req->n = 2;
+}
+
+static void req_uint(WlRequest* req, uint32_t v) {
+    req->words[req->n++] = v;
+}
+
+static void req_string(WlRequest* req, const char* s) {
+    // length including the nul terminator, then the string padded to 32 bits
+    uint32_t ln = strlen(s) + 1;
+    req_uint(req, ln);
+    memset(&req->words[req->n], 0, (ln + 3) / 4 * 4);
+    memcpy(&req->words[req->n], s, ln);
+    req->n += (ln + 3) / 4;
+}
+
+static int req_send(WlClient* wl, WlRequest* req, uint16_t opcode) {
+    size_t size = req->n * 4;
+    req->words[1] = (uint32_t)size << 16 | opcode;
+    const char* p = (const char*)req->words;
+    while (size > 0) {
+        ssize_t res = send(wl->fd, p, size, MSG_NOSIGNAL);
+        if (res < 0 && errno == EINTR) continue;
+        if (res <= 0) return -1;
+        p += res;
+        size -= res;
+    }
+    return 0;
+}
+
+static const char* arg_string(const unsigned char* args, size_t len, size_t* pos) {
+    if (*pos + 4 > len) return NULL;
+    uint32_t ln;
+    memcpy(&ln, args + *pos, 4);
+    *pos += 4;
+    if (ln == 0 || ln > len - *pos || args[*pos + ln - 1] != 0) return NULL;
+    const char* res = (const char*)args + *pos;
+    *pos += (ln + 3) / 4 * 4;
+    return res;
+}
+
+static int wl_receive(WlClient* wl) {
+    struct iovec iov = {wl->in + wl->in_len, sizeof(wl->in) - wl->in_len};
+    char control[CMSG_SPACE(sizeof(int) * 16)];
+    struct msghdr msg = {NULL, 0, &iov, 1, control, sizeof(control), 0};
+    ssize_t res;
+    do {
+        res = recvmsg(wl->fd, &msg, MSG_CMSG_CLOEXEC);
+    } while (res < 0 && errno == EINTR);
+    if (res <= 0) return -1;
+    wl->in_len += res;
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+        int n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        int* fds = (int*)CMSG_DATA(cmsg);
+        for (int i = 0; i < n; ++i) {
+            if (wl->n_fds < 16) {
+                wl->fds[wl->n_fds++] = fds[i];
+            } else {
+                close(fds[i]);
+            }
+        }
+    }
+    return 0;
+}
+
+static int wl_dispatch(WlClient* wl) {
+    uint32_t header[2];
+    while (wl->in_len < 8 ||
+           (memcpy(header, wl->in, 8), wl->in_len < (header[1] >> 16))) {
+        if (wl->in_len == sizeof(wl->in) || wl_receive(wl)) return -1;
+    }
+    uint32_t id = header[0];
+    uint16_t opcode = header[1] & 0xffff;
+    size_t size = header[1] >> 16;
+    if (size < 8) return -1;
+    const unsigned char* args = wl->in + 8;
+    size_t len = size - 8;
+    size_t pos = 0;
+    int res = 0;
+    if (id == IdDisplay && opcode == DISPLAY_ERROR) {
+        pos = 8;
+        const char* message = arg_string(args, len, &pos);
+        fprintf(stderr, "Wayland error: %s\n", message ? message : "unknown");
+        res = -1;
+    } else if (id == IdRegistry && opcode == REGISTRY_GLOBAL && len >= 4) {
+        uint32_t name, version = 0;
+        memcpy(&name, args, 4);
+        pos = 4;
+        const char* interface = arg_string(args, len, &pos);
+        if (pos + 4 <= len) memcpy(&version, args + pos, 4);
+        if (!interface) {
+            res = -1;
+        } else if (strcmp(interface, "wl_seat") == 0 && !wl->seat_name) {
+            wl->seat_name = name;
+        } else if (strcmp(interface, EXT_MANAGER) == 0 ||
+                   (strcmp(interface, WLR_MANAGER) == 0 && !wl->manager_name)) {
+            // the standard protocol is preferred
+            wl->manager_name = name;
+            wl->manager_version = version;
+            wl->manager_interface = interface[0] == 'e' ? EXT_MANAGER : WLR_MANAGER;
+        }
+    } else if (id == wl->sync_id && opcode == CALLBACK_DONE) {
+        wl->synced = 1;
+    } else if ((id == IdSource || id == IdPrimarySource) && opcode == SOURCE_SEND) {
+        // the file descriptor to write the text to comes with the message
+        if (wl->n_fds > 0) {
+            int fd = wl->fds[0];
+            memmove(wl->fds, wl->fds + 1, --wl->n_fds * sizeof(int));
+            const char* p = wl->text;
+            size_t remaining = strlen(p);
+            while (remaining > 0) {
+                ssize_t written = write(fd, p, remaining);
+                if (written < 0 && errno == EINTR) continue;
+                if (written <= 0) break;
+                p += written;
+                remaining -= written;
+            }
+            close(fd);
+        }
+    } else if ((id == IdSource || id == IdPrimarySource) && opcode == SOURCE_CANCELLED) {
+        --wl->owned;
+    }
+    // events of other objects (like the offers of the data device) are ignored
+    memmove(wl->in, wl->in + size, wl->in_len - size);
+    wl->in_len -= size;
+    return res;
+}
+
+static int wl_roundtrip(WlClient* wl, uint32_t id) {
+    WlRequest req;
+    req_begin(&req, IdDisplay);
+    req_uint(&req, id);
+    wl->sync_id = id;
+    wl->synced = 0;
+    if (req_send(wl, &req, DISPLAY_SYNC)) return -1;
+    while (!wl->synced) {
+        if (wl_dispatch(wl)) return -1;
+    }
+    return 0;
+}
+
+static int wl_set_selection(WlClient* wl, uint32_t source, int primary) {
+    WlRequest req;
+    req_begin(&req, IdManager);
+    req_uint(&req, source);
+    if (req_send(wl, &req, MANAGER_CREATE_DATA_SOURCE)) return -1;
+    for (const char** mime = MIME_TYPES; *mime; ++mime) {
+        req_begin(&req, source);
+        req_string(&req, *mime);
+        if (req_send(wl, &req, SOURCE_OFFER)) return -1;
+    }
+    req_begin(&req, IdDevice);
+    req_uint(&req, source);
+    if (req_send(wl, &req, primary ? DEVICE_SET_PRIMARY_SELECTION : DEVICE_SET_SELECTION)) {
+        return -1;
+    }
+    ++wl->owned;
+    return 0;
+}
+
+int wlclip_copy(const char* text) {
+    WlClient wl;
+    memset(&wl, 0, sizeof(wl));
+    wl.text = text;
+    wl.fd = wl_connect();
+    if (wl.fd < 0) {
+        fprintf(stderr, "Couldn't connect to the Wayland compositor\n");
+        return -1;
+    }
+    WlRequest req;
+    req_begin(&req, IdDisplay);
+    req_uint(&req, IdRegistry);
+    int res = req_send(&wl, &req, DISPLAY_GET_REGISTRY) || wl_roundtrip(&wl, IdSync);
+    if (!res && (!wl.seat_name || !wl.manager_name)) {
+        fprintf(stderr, "The Wayland compositor doesn't support the data-control protocol\n");
+        res = -1;
+    }
+    // primary selection is supported since version 2 of the wlr protocol
+    int ext = wl.manager_interface && strcmp(wl.manager_interface, EXT_MANAGER) == 0;
+    int primary = ext || wl.manager_version >= 2;
+    if (!res) {
+        req_begin(&req, IdRegistry);
+        req_uint(&req, wl.seat_name);
+        req_string(&req, "wl_seat");
+        req_uint(&req, 1);
+        req_uint(&req, IdSeat);
+        res = req_send(&wl, &req, REGISTRY_BIND);
+    }
+    if (!res) {
+        req_begin(&req, IdRegistry);
+        req_uint(&req, wl.manager_name);
+        req_string(&req, wl.manager_interface);
+        req_uint(&req, primary && !ext ? 2 : 1);
+        req_uint(&req, IdManager);
+        res = req_send(&wl, &req, REGISTRY_BIND);
+    }
+    if (!res) {
+        req_begin(&req, IdManager);
+        req_uint(&req, IdDevice);
+        req_uint(&req, IdSeat);
+        res = req_send(&wl, &req, MANAGER_GET_DATA_DEVICE);
+    }
+    if (!res) res = wl_set_selection(&wl, IdSource, 0);
+    if (!res && primary) res = wl_set_selection(&wl, IdPrimarySource, 1);
+    // wait for the compositor to process the requests, to report errors
+    if (!res) res = wl_roundtrip(&wl, IdSync2);
+    if (res) {
+        close(wl.fd);
+        return -1;
+    }
+
+    // serve the selections from a detached process, until they're replaced
+    pid_t pid = fork();
+    if (pid != 0) {
+        close(wl.fd);
+        for (int i = 0; i < wl.n_fds; ++i) close(wl.fds[i]);
+        if (pid > 0) waitpid(pid, NULL, 0);
+        return pid > 0 ? 0 : -1;
+    }
+    if (fork() != 0) _exit(0);
+    setsid();
+    signal(SIGPIPE, SIG_IGN);
+    while (wl.owned > 0 && wl_dispatch(&wl) == 0) {}
+    _exit(0);
+}
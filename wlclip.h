@@ -0,0 +1,13 @@
+#ifndef WLCLIP_H
+#define WLCLIP_H
+
+/* Wayland clipboard through the data-control protocol (ext-data-control-v1 or
+ * wlr-data-control-unstable-v1), spoken directly over the compositor socket without
+ * libwayland or helper programs like wl-copy. */
+
+/* Set the clipboard and the primary selection to `text`. The selections are owned by a
+ * detached process that serves `text` to the applications pasting it, until another
+ * client sets the selections. Return 0 on success, else print an error and return -1. */
+int wlclip_copy(const char* text);
+
+#endif